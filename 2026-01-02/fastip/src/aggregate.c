@@ -0,0 +1,589 @@
+/*
+    Counting addresses as they're parsed
+
+ A common job is counting hits per source address, or per /24, over
+ a day of logs. Parsing everything into an array of addresses and
+ then counting it writes the whole array out to memory and reads it
+ back. This counts the addresses a chunk at a time as they're
+ parsed instead, while the chunk is still in the L1 cache.
+
+ There are three kinds of counter:
+ - `AGG_PER24`: a flat array of 16M 32-bit counters, one per /24,
+   indexed by the top 24 bits. No hashing or probing, but 64 MB, so
+   the counts for the next few addresses are prefetched while this
+   one is counted.
+ - `AGG_ADDRESS`: an open-addressing hash table of address to count,
+   for any number of addresses. Keys are in groups of 4, a 16-byte
+   line, and a probe compares all 4 at once with SSE2, for both the
+   key and an empty slot. Full groups go on to the next group, as in
+   linear probing. It grows at 3/4 full. Address 0, which marks an
+   empty slot, is counted on its own.
+ - `AGG_TOPK`: the space-saving algorithm, for the heavy hitters in
+   bounded memory. It keeps `k` counters, in a min-heap by count,
+   with a small hash index from address to heap slot. An address
+   that isn't counted takes over the smallest counter, adding 1 to
+   its count and remembering the old count as its possible error.
+   Any address with more than `n/k` hits is always in the result,
+   and no count is too low.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum agg_kind {
+    AGG_PER24 = 0,
+    AGG_ADDRESS = 1,
+    AGG_TOPK = 2,
+};
+
+enum {
+    PER24_SIZE = 1 << 24,
+    GROUP = 4,                  /* keys per probe */
+    PREFETCH = 16,              /* addresses ahead */
+    CHUNK = 1024,               /* addresses parsed per count */
+};
+
+struct agg {
+    int kind;
+    uint64_t total;
+    /* AGG_PER24 */
+    uint32_t *per24;
+    /* AGG_ADDRESS */
+    uint32_t *keys;
+    uint32_t *counts;
+    size_t groups;              /* a power of 2 */
+    size_t used;
+    uint64_t zero_count;
+    /* AGG_TOPK */
+    size_t k;
+    size_t heap_count;
+    uint32_t *heap_keys;
+    uint64_t *heap_counts;
+    uint64_t *heap_errors;
+    size_t *heap_index;         /* where in the index each one is */
+    uint32_t *index;            /* heap slot + 1, or 0 if empty */
+    size_t index_mask;
+};
+
+static inline size_t
+hash32(uint32_t x) {
+    return (size_t)((x * 0x9E3779B1u) ^ (x >> 15));
+}
+
+/*
+ * ---- AGG_ADDRESS ----
+ */
+
+static int
+table_alloc(struct agg *a, size_t groups) {
+    a->keys = aligned_alloc(64, groups * GROUP * sizeof(*a->keys));
+    a->counts = malloc(groups * GROUP * sizeof(*a->counts));
+    if (a->keys == NULL || a->counts == NULL) {
+        free(a->keys);
+        free(a->counts);
+        return -1;
+    }
+    memset(a->keys, 0, groups * GROUP * sizeof(*a->keys));
+    a->groups = groups;
+    a->used = 0;
+    return 0;
+}
+
+/**
+ * @returns the slot of `key`, after adding it with a count of 0 if
+ * it wasn't there
+ */
+static inline size_t
+table_slot(struct agg *a, uint32_t key) {
+    size_t mask = a->groups - 1;
+    size_t g = hash32(key) & mask;
+
+    for (;;) {
+        uint32_t *keys = a->keys + g * GROUP;
+#if defined(__SSE2__)
+        __m128i v = _mm_load_si128((const __m128i *)keys);
+        unsigned found = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_set1_epi32((int)key))));
+        unsigned empty;
+
+        if (found)
+            return g * GROUP + (size_t)__builtin_ctz(found);
+        empty = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_setzero_si128())));
+        if (empty) {
+            size_t slot = g * GROUP + (size_t)__builtin_ctz(empty);
+            a->keys[slot] = key;
+            a->counts[slot] = 0;
+            a->used++;
+            return slot;
+        }
+#else
+        int i;
+        for (i=0; i<GROUP; i++) {
+            if (keys[i] == key)
+                return g * GROUP + (size_t)i;
+            if (keys[i] == 0) {
+                keys[i] = key;
+                a->counts[g * GROUP + (size_t)i] = 0;
+                a->used++;
+                return g * GROUP + (size_t)i;
+            }
+        }
+#endif
+        g = (g + 1) & mask;
+    }
+}
+
+static int
+table_grow(struct agg *a) {
+    uint32_t *keys = a->keys;
+    uint32_t *counts = a->counts;
+    size_t n = a->groups * GROUP;
+    size_t i;
+
+    if (table_alloc(a, a->groups * 2) != 0) {
+        a->keys = keys;
+        a->counts = counts;
+        return -1;
+    }
+    for (i=0; i<n; i++) {
+        if (keys[i])
+            a->counts[table_slot(a, keys[i])] = counts[i];
+    }
+    free(keys);
+    free(counts);
+    return 0;
+}
+
+static int
+table_add(struct agg *a, const uint32_t *addresses, size_t count) {
+    size_t i;
+
+    for (i=0; i<count; i++) {
+        uint32_t x = addresses[i];
+
+        if (i + PREFETCH < count)
+            __builtin_prefetch(a->keys + (hash32(addresses[i + PREFETCH]) & (a->groups - 1)) * GROUP);
+        if (x == 0) {
+            a->zero_count++;
+            continue;
+        }
+        if (a->used * 4 >= a->groups * GROUP * 3 && table_grow(a) != 0)
+            return -1;
+        a->counts[table_slot(a, x)]++;
+    }
+    return 0;
+}
+
+/*
+ * ---- AGG_TOPK ----
+ */
+
+/**
+ * @returns the index slot for `key`: the one holding it, or the
+ * empty one where it would go
+ */
+static size_t
+index_find(const struct agg *a, uint32_t key) {
+    size_t i = hash32(key) & a->index_mask;
+
+    while (a->index[i] && a->heap_keys[a->index[i] - 1] != key)
+        i = (i + 1) & a->index_mask;
+    return i;
+}
+
+/**
+ * Swaps two heap entries, and where the index points to them.
+ */
+static void
+heap_swap(struct agg *a, size_t i, size_t j) {
+    size_t at_i = a->heap_index[i];
+    size_t at_j = a->heap_index[j];
+    uint32_t key = a->heap_keys[i];
+    uint64_t count = a->heap_counts[i];
+    uint64_t error = a->heap_errors[i];
+
+    a->heap_keys[i] = a->heap_keys[j];
+    a->heap_counts[i] = a->heap_counts[j];
+    a->heap_errors[i] = a->heap_errors[j];
+    a->heap_keys[j] = key;
+    a->heap_counts[j] = count;
+    a->heap_errors[j] = error;
+    a->heap_index[i] = at_j;
+    a->heap_index[j] = at_i;
+    a->index[at_i] = (uint32_t)j + 1;
+    a->index[at_j] = (uint32_t)i + 1;
+}
+
+/**
+ * Removes an entry from the index, moving back the ones after it
+ * that would then be unreachable, so there are no tombstones.
+ */
+static void
+index_remove(struct agg *a, size_t i) {
+    size_t j = i;
+
+    a->index[i] = 0;
+    for (;;) {
+        size_t home;
+
+        j = (j + 1) & a->index_mask;
+        if (a->index[j] == 0)
+            return;
+        home = hash32(a->heap_keys[a->index[j] - 1]) & a->index_mask;
+        /* Move it back if its home isn't in (i, j] */
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            a->index[i] = a->index[j];
+            a->index[j] = 0;
+            a->heap_index[a->index[i] - 1] = i;
+            i = j;
+        }
+    }
+}
+
+/**
+ * Moves a heap entry whose count went up down to its place, keeping
+ * the index pointing at it.
+ */
+static void
+heap_down(struct agg *a, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+
+        if (l < a->heap_count && a->heap_counts[l] < a->heap_counts[smallest])
+            smallest = l;
+        if (r < a->heap_count && a->heap_counts[r] < a->heap_counts[smallest])
+            smallest = r;
+        if (smallest == i)
+            return;
+        heap_swap(a, i, smallest);
+        i = smallest;
+    }
+}
+
+static void
+topk_add(struct agg *a, const uint32_t *addresses, size_t count) {
+    size_t n;
+
+    for (n=0; n<count; n++) {
+        uint32_t x = addresses[n];
+        size_t i = index_find(a, x);
+
+        if (a->index[i]) {
+            size_t slot = a->index[i] - 1;
+            a->heap_counts[slot]++;
+            heap_down(a, slot);
+        } else if (a->heap_count < a->k) {
+            /* Still room, and a count of 1 is the smallest there is,
+             * so it goes at the top and moves down */
+            size_t slot = a->heap_count++;
+            a->heap_keys[slot] = x;
+            a->heap_counts[slot] = 1;
+            a->heap_errors[slot] = 0;
+            a->index[i] = (uint32_t)slot + 1;
+            a->heap_index[slot] = i;
+            while (slot > 0 && a->heap_counts[(slot - 1) / 2] > a->heap_counts[slot]) {
+                size_t parent = (slot - 1) / 2;
+                heap_swap(a, slot, parent);
+                slot = parent;
+            }
+        } else {
+            /* Take over the smallest counter */
+            index_remove(a, a->heap_index[0]);
+            a->heap_errors[0] = a->heap_counts[0];
+            a->heap_counts[0]++;
+            a->heap_keys[0] = x;
+            a->heap_index[0] = index_find(a, x);
+            a->index[a->heap_index[0]] = 1;
+            heap_down(a, 0);
+        }
+    }
+}
+
+/*
+ * ---- The interface ----
+ */
+
+/**
+ * Creates a counter of the given kind. `k` is the number of counters
+ * for `AGG_TOPK`, and is ignored by the others.
+ * @returns NULL if out of memory
+ */
+struct agg *
+agg_create(int kind, size_t k) {
+    struct agg *a = calloc(1, sizeof(*a));
+
+    if (a == NULL)
+        return NULL;
+    a->kind = kind;
+    switch (kind) {
+    case AGG_PER24:
+        /* 64-MB, a counter per /24, but only the pages of /24s that
+         * addresses fall in are ever written. A log from a few
+         * networks uses a few of them. */
+        a->per24 = calloc(PER24_SIZE, sizeof(*a->per24));
+        if (a->per24 == NULL)
+            goto fail;
+        break;
+    case AGG_ADDRESS:
+        if (table_alloc(a, 1024) != 0)
+            goto fail;
+        break;
+    case AGG_TOPK: {
+        size_t size = 2;
+
+        if (k == 0)
+            k = 1;
+        while (size < k * 2)
+            size *= 2;
+        a->k = k;
+        a->heap_keys = malloc(k * sizeof(*a->heap_keys));
+        a->heap_counts = malloc(k * sizeof(*a->heap_counts));
+        a->heap_errors = malloc(k * sizeof(*a->heap_errors));
+        a->heap_index = malloc(k * sizeof(*a->heap_index));
+        a->index = calloc(size, sizeof(*a->index));
+        a->index_mask = size - 1;
+        if (!a->heap_keys || !a->heap_counts || !a->heap_errors || !a->heap_index || !a->index)
+            goto fail;
+        break;
+    }
+    default:
+        goto fail;
+    }
+    return a;
+fail:
+    free(a->per24);
+    free(a->heap_keys);
+    free(a->heap_counts);
+    free(a->heap_errors);
+    free(a->heap_index);
+    free(a->index);
+    free(a);
+    return NULL;
+}
+
+void
+agg_free(struct agg *a) {
+    if (a == NULL)
+        return;
+    free(a->per24);
+    free(a->keys);
+    free(a->counts);
+    free(a->heap_keys);
+    free(a->heap_counts);
+    free(a->heap_errors);
+    free(a->heap_index);
+    free(a->index);
+    free(a);
+}
+
+/**
+ * Counts `count` addresses.
+ * @returns 0, or -1 if out of memory
+ */
+int
+agg_add(struct agg *a, const uint32_t *addresses, size_t count) {
+    size_t i;
+
+    a->total += count;
+    switch (a->kind) {
+    case AGG_PER24:
+        for (i=0; i<count; i++) {
+            if (i + PREFETCH < count)
+                __builtin_prefetch(&a->per24[addresses[i + PREFETCH] >> 8], 1);
+            a->per24[addresses[i] >> 8]++;
+        }
+        return 0;
+    case AGG_ADDRESS:
+        return table_add(a, addresses, count);
+    default:
+        topk_add(a, addresses, count);
+        return 0;
+    }
+}
+
+/**
+ * `agg_add()` as a sink for `parse_ip_fd()`, with the counter as its
+ * argument.
+ */
+void
+agg_sink(const uint32_t *addresses, size_t count, void *arg) {
+    agg_add(arg, addresses, count);
+}
+
+/**
+ * Parses the addresses in `buf` with `streamer` and counts them, a
+ * chunk at a time. Like a streamer, `*consumed` is set to how much of
+ * the text was used.
+ * @returns the number of addresses counted
+ */
+size_t
+agg_parse(struct agg *a, const char *buf, size_t len,
+          size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *), size_t *consumed) {
+    uint32_t chunk[CHUNK];
+    size_t offset = 0;
+    size_t n = 0;
+
+    for (;;) {
+        size_t used;
+        size_t count = streamer(buf + offset, len - offset, chunk, CHUNK, &used);
+
+        agg_add(a, chunk, count);
+        n += count;
+        offset += used;
+        if (count < CHUNK)
+            break;
+    }
+    *consumed = offset;
+    return n;
+}
+
+/**
+ * @returns the number of addresses counted so far
+ */
+uint64_t
+agg_total(const struct agg *a) {
+    return a->total;
+}
+
+/**
+ * @returns the bytes the counters take
+ */
+size_t
+agg_memory(const struct agg *a) {
+    switch (a->kind) {
+    case AGG_PER24:
+        return PER24_SIZE * sizeof(*a->per24);
+    case AGG_ADDRESS:
+        return a->groups * GROUP * (sizeof(*a->keys) + sizeof(*a->counts));
+    default:
+        return a->k * (sizeof(*a->heap_keys) + sizeof(*a->heap_counts) + sizeof(*a->heap_errors)
+                       + sizeof(*a->heap_index))
+             + (a->index_mask + 1) * sizeof(*a->index);
+    }
+}
+
+/*
+ * For `agg_top()`, a min-heap of the best so far
+ */
+struct top {
+    uint32_t *keys;
+    uint64_t *counts;
+    size_t n;
+    size_t max;
+};
+
+static void
+top_offer(struct top *t, uint32_t key, uint64_t count) {
+    size_t i;
+
+    if (t->n < t->max)
+        i = t->n++;
+    else if (count > t->counts[0]) {
+        /* Replace the smallest, and move it down */
+        i = 0;
+        for (;;) {
+            size_t l = 2 * i + 1;
+            size_t r = l + 1;
+            size_t c = l;
+
+            if (l >= t->n)
+                break;
+            if (r < t->n && t->counts[r] < t->counts[l])
+                c = r;
+            if (t->counts[c] >= count)
+                break;
+            t->keys[i] = t->keys[c];
+            t->counts[i] = t->counts[c];
+            i = c;
+        }
+        t->keys[i] = key;
+        t->counts[i] = count;
+        return;
+    } else
+        return;
+
+    /* Added at the end, so move it up */
+    while (i > 0 && t->counts[(i - 1) / 2] > count) {
+        t->keys[i] = t->keys[(i - 1) / 2];
+        t->counts[i] = t->counts[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    t->keys[i] = key;
+    t->counts[i] = count;
+}
+
+/**
+ * Finds the `max` biggest counts, largest first, as addresses (the
+ * first address of the /24 for `AGG_PER24`) and their counts. For
+ * `AGG_TOPK` the counts may be too high, by up to the error in
+ * `errors[]`, if it isn't NULL; for the others the error is 0.
+ * @returns how many were found
+ */
+size_t
+agg_top(const struct agg *a, size_t max, uint32_t *keys, uint64_t *counts, uint64_t *errors) {
+    struct top t = {keys, counts, 0, max};
+    size_t found;
+    size_t i;
+
+    switch (a->kind) {
+    case AGG_PER24:
+        for (i=0; i<PER24_SIZE; i++) {
+            if (a->per24[i])
+                top_offer(&t, (uint32_t)i << 8, a->per24[i]);
+        }
+        break;
+    case AGG_ADDRESS:
+        if (a->zero_count)
+            top_offer(&t, 0, a->zero_count);
+        for (i=0; i<a->groups * GROUP; i++) {
+            if (a->keys[i])
+                top_offer(&t, a->keys[i], a->counts[i]);
+        }
+        break;
+    default:
+        for (i=0; i<a->heap_count; i++)
+            top_offer(&t, a->heap_keys[i], a->heap_counts[i]);
+        break;
+    }
+
+    /* A heap sort: taking the smallest off to the end each time
+     * leaves them largest first */
+    found = t.n;
+    while (t.n > 1) {
+        uint32_t key = t.keys[0];
+        uint64_t count = t.counts[0];
+
+        t.n--;
+        t.keys[0] = t.keys[t.n];
+        t.counts[0] = t.counts[t.n];
+        t.keys[t.n] = key;
+        t.counts[t.n] = count;
+        for (i=0;;) {
+            size_t l = 2 * i + 1;
+            size_t r = l + 1;
+            size_t c = l;
+
+            if (l >= t.n)
+                break;
+            if (r < t.n && t.counts[r] < t.counts[l])
+                c = r;
+            if (t.counts[c] >= t.counts[i])
+                break;
+            key = t.keys[i]; t.keys[i] = t.keys[c]; t.keys[c] = key;
+            count = t.counts[i]; t.counts[i] = t.counts[c]; t.counts[c] = count;
+            i = c;
+        }
+    }
+
+    if (errors) {
+        for (i=0; i<found; i++)
+            errors[i] = a->kind == AGG_TOPK ? a->heap_errors[a->index[index_find(a, keys[i])] - 1] : 0;
+    }
+    return found;
+}
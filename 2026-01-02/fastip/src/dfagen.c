@@ -0,0 +1,197 @@
+/*
+    Code generator for the `dfa` parser
+
+ The `dfa` parser interprets a table, and `fsm2` is the same state
+ machine written out by hand. This program writes out the C code
+ for the state machine automatically, from the table built by
+ `parse_ip_dfa_init()`, so that changes to the grammar there (like
+ which bytes terminate an address) only have to be made once.
+
+ In the generated code:
+ - every state is a label, and moving to a state is a `goto`
+ - the bytes that go to the same next state become a chain of
+   range compares, biggest group first (which is the digits)
+ - the `nums[]` update of the next state is inlined, so each
+   octet is its own local variable
+ - any byte not listed goes to ERROR, which is `return 0`
+
+ The Makefile runs this at build time, writing the generated source
+ to `tmp/gen/parse-ip-dfagen.c`. The function it defines is
+ `parse_ip_dfagen()`, which works exactly like `parse_ip_dfa()`.
+ */
+#include <stdio.h>
+
+void parse_ip_dfa_init(void);
+int parse_ip_dfa_next(int state, unsigned c);
+int parse_ip_dfa_octet(int state);
+void parse_ip_dfa_special(int *start, int *done, int *error);
+
+/*
+ * A run of consecutive byte values that all go to the same state.
+ */
+struct run {
+    unsigned first;
+    unsigned last;
+};
+
+/**
+ * Print a byte value as a character constant where that's readable.
+ */
+static void print_byte(FILE *fp, unsigned c) {
+    if (c == '\\' || c == '\'')
+        fprintf(fp, "'\\%c'", c);
+    else if (c >= 0x20 && c < 0x7F)
+        fprintf(fp, "'%c'", c);
+    else
+        fprintf(fp, "%u", c);
+}
+
+/**
+ * Print the test for the bytes in `runs[]`, like
+ * `(c >= '0' && c <= '9') || c == ' '`.
+ */
+static void print_test(FILE *fp, const struct run *runs, unsigned count) {
+    unsigned i;
+
+    for (i=0; i<count; i++) {
+        if (i)
+            fprintf(fp, " || ");
+        if (runs[i].first == runs[i].last) {
+            fprintf(fp, "c == ");
+            print_byte(fp, runs[i].first);
+        } else {
+            fprintf(fp, count > 1 ? "(c >= " : "c >= ");
+            print_byte(fp, runs[i].first);
+            fprintf(fp, " && c <= ");
+            print_byte(fp, runs[i].last);
+            if (count > 1)
+                fprintf(fp, ")");
+        }
+    }
+}
+
+/**
+ * Print the code for one state: fetch the next byte, then one `if`
+ * for each possible next state.
+ */
+static void print_state(FILE *fp, int state, int done, int error) {
+    int targets[256];
+    unsigned sizes[256];
+    unsigned target_count = 0;
+    unsigned c;
+
+    /* The distinct next states, other than ERROR */
+    for (c=0; c<256; c++) {
+        int next = parse_ip_dfa_next(state, c);
+        unsigned i;
+
+        if (next == error)
+            continue;
+        for (i=0; i<target_count && targets[i] != next; i++)
+            ;
+        if (i == target_count) {
+            targets[target_count] = next;
+            sizes[target_count++] = 0;
+        }
+        sizes[i]++;
+    }
+
+    fprintf(fp, "s%d:\n", state);
+    fprintf(fp, "    if (offset == length)\n");
+    fprintf(fp, "        goto end;\n");
+    fprintf(fp, "    c = (unsigned char)buf[offset++];\n");
+
+    while (target_count) {
+        struct run runs[256];
+        unsigned run_count = 0;
+        unsigned best = 0;
+        unsigned i;
+        int next;
+        int octet;
+
+        /* Test the most common transition first */
+        for (i=1; i<target_count; i++) {
+            if (sizes[i] > sizes[best])
+                best = i;
+        }
+        next = targets[best];
+        targets[best] = targets[--target_count];
+        sizes[best] = sizes[target_count];
+
+        for (c=0; c<256; c++) {
+            if (parse_ip_dfa_next(state, c) != next)
+                continue;
+            if (run_count && runs[run_count-1].last + 1 == c)
+                runs[run_count-1].last = c;
+            else {
+                runs[run_count].first = c;
+                runs[run_count++].last = c;
+            }
+        }
+
+        fprintf(fp, "    if (");
+        print_test(fp, runs, run_count);
+        fprintf(fp, ") {\n");
+        octet = parse_ip_dfa_octet(next);
+        if (octet)
+            fprintf(fp, "        n%d = n%d * 10 + (c - '0');\n", octet, octet);
+        if (next == done)
+            fprintf(fp, "        goto done;\n");
+        else
+            fprintf(fp, "        goto s%d;\n", next);
+        fprintf(fp, "    }\n");
+    }
+    fprintf(fp, "    return 0;\n\n");
+}
+
+int main(void) {
+    FILE *fp = stdout;
+    int start, done, error;
+    int octets = 0;
+    int state;
+    int k;
+
+    parse_ip_dfa_init();
+    parse_ip_dfa_special(&start, &done, &error);
+
+    for (state=0; state<error; state++) {
+        if (parse_ip_dfa_octet(state) > octets)
+            octets = parse_ip_dfa_octet(state);
+    }
+
+    fprintf(fp, "/*\n    Generated by `dfagen` from the `dfa` tables. Do not edit.\n */\n");
+    fprintf(fp, "#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(fp, "size_t parse_ip_dfagen(const char *buf, size_t length, uint32_t *out);\n\n");
+    fprintf(fp, "size_t parse_ip_dfagen(const char *buf, size_t length, uint32_t *out) {\n");
+    fprintf(fp, "    size_t offset = 0;\n");
+    fprintf(fp, "    unsigned c;\n");
+    for (k=1; k<=octets; k++)
+        fprintf(fp, "    unsigned n%d = 0;\n", k);
+    fprintf(fp, "\n");
+    fprintf(fp, "    goto s%d;\n\n", start);
+
+    for (state=0; state<error; state++) {
+        if (state != done)
+            print_state(fp, state, done, error);
+    }
+
+    fprintf(fp, "done:\n");
+    fprintf(fp, "    offset--;  /* not counting the terminator */\n");
+    fprintf(fp, "end:\n");
+    fprintf(fp, "    if (");
+    for (k=1; k<=octets; k++)
+        fprintf(fp, "%s(n%d > 255)", k > 1 ? " | " : "", k);
+    fprintf(fp, ")\n        return 0;\n");
+    fprintf(fp, "    *out = ");
+    for (k=1; k<=octets; k++)
+        fprintf(fp, "%sn%d << %d", k > 1 ? " | " : "", k, 8 * (octets - k));
+    fprintf(fp, ";\n");
+    fprintf(fp, "    return offset;\n");
+    fprintf(fp, "}\n");
+
+    if (ferror(fp)) {
+        fprintf(stderr, "[-] dfagen: write error\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,258 @@
+/*
+    Format IPv4 addresses as text, the reverse of parsing
+
+ `snprintf("%u.%u.%u.%u")` goes through the format string and a
+ general integer conversion for each octet, and is slower than any of
+ the parsers. An octet is only 0-255, so there are faster ways.
+
+ Each formatter writes an address without a terminator, and returns
+ its length, 7 to 15. They may write up to 16 bytes, past the end of
+ the address, so the buffer needs that much room.
+
+ - `format_ip_table()`: a table of the 256 octets' text, 4 bytes each
+   (the digits, and the length in the last byte), so each octet is a
+   4-byte load and a 4-byte store, with a '.' after it.
+ - `format_ip_swar()`: no table and no branches. The four octets are
+   put in the four 16-bit lanes of a 64-bit word, and the hundreds,
+   tens, and ones of all four are found at once, dividing by 100 and
+   10 with multiplies and shifts. Each octet's three digits and a '.'
+   are then shifted right to drop its leading zeroes, and stored.
+ - `format_ip_batch_sse()`: four addresses at a time, with SSSE3. The
+   digits of all 16 octets are found in 16-bit lanes, the same way.
+   Each address's digits, and a '.' and the separator, are gathered
+   into one register, and a `pshufb` puts them in order, skipping the
+   leading zeroes, with a shuffle mask picked by the lengths of its
+   four octets (one of 3^4 = 81). Each address is one 16-byte store.
+   Without SSE it formats them one at a time with `format_ip_swar()`.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * ---- table ----
+ */
+
+static uint32_t octet_text[256];
+
+static void
+table_init(void) {
+    unsigned i;
+
+    for (i=0; i<256; i++) {
+        unsigned char text[4] = {0, 0, 0, 0};
+        unsigned n = 0;
+
+        if (i >= 100)
+            text[n++] = (unsigned char)('0' + i / 100);
+        if (i >= 10)
+            text[n++] = (unsigned char)('0' + i / 10 % 10);
+        text[n++] = (unsigned char)('0' + i % 10);
+        text[3] = (unsigned char)n;
+        memcpy(&octet_text[i], text, 4);
+    }
+}
+
+static inline size_t
+put_octet(char *out, size_t n, unsigned octet, char after) {
+    uint32_t text = octet_text[octet];
+    size_t length = ((const unsigned char *)&text)[3];
+
+    memcpy(out + n, &text, 4);
+    out[n + length] = after;
+    return n + length + 1;
+}
+
+size_t
+format_ip_table(uint32_t ip, char *out) {
+    size_t n = 0;
+
+    n = put_octet(out, n, ip >> 24, '.');
+    n = put_octet(out, n, (ip >> 16) & 0xFF, '.');
+    n = put_octet(out, n, (ip >> 8) & 0xFF, '.');
+    n = put_octet(out, n, ip & 0xFF, '.');
+    return n - 1;
+}
+
+/*
+ * ---- swar ----
+ */
+
+#define LANES 0x0001000100010001ULL
+
+/**
+ * Stores one octet from its lane: the hundreds and tens digits in
+ * `digits`, the ones digit in `ones`. The text is the three digits and
+ * a '.', shifted right to drop the leading zeroes.
+ */
+static inline size_t
+put_lane(char *out, size_t n, uint64_t digits, uint64_t ones, uint64_t lengths, int lane) {
+    uint32_t length = (uint32_t)(lengths >> lane) & 3;
+    uint32_t text = ((uint32_t)(digits >> lane) & 0xFFFF)
+                  | ((uint32_t)(ones >> lane) & 0xF) << 16
+                  | 0x2E303030u;    /* '.' and '0's */
+
+    text >>= (3 - length) * 8;
+    memcpy(out + n, &text, 4);
+    return n + length + 1;
+}
+
+size_t
+format_ip_swar(uint32_t ip, char *out) {
+    /* The first octet in the lowest lane */
+    uint64_t v = (uint64_t)(ip >> 24) | (uint64_t)((ip >> 16) & 0xFF) << 16
+               | (uint64_t)((ip >> 8) & 0xFF) << 32 | (uint64_t)(ip & 0xFF) << 48;
+    /* x/100 is (x*41)>>12, and x/10 is (x*103)>>10, for these x */
+    uint64_t hundreds = ((v * 41) >> 12) & (LANES * 0xF);
+    uint64_t rest = v - hundreds * 100;
+    uint64_t tens = ((rest * 103) >> 10) & (LANES * 0xF);
+    uint64_t ones = rest - tens * 10;
+    /* 1 in each lane that's at least 10, or at least 100 */
+    uint64_t ge10 = ((v + LANES * (0x8000 - 10)) >> 15) & LANES;
+    uint64_t ge100 = ((v + LANES * (0x8000 - 100)) >> 15) & LANES;
+    uint64_t lengths = LANES + ge10 + ge100;
+    uint64_t digits = hundreds | tens << 8;
+    size_t n = 0;
+
+    n = put_lane(out, n, digits, ones, lengths, 0);
+    n = put_lane(out, n, digits, ones, lengths, 16);
+    n = put_lane(out, n, digits, ones, lengths, 32);
+    n = put_lane(out, n, digits, ones, lengths, 48);
+    return n - 1;
+}
+
+/**
+ * Formats `count` addresses, each followed by `separator`, with
+ * `format_ip_swar()`. This is what `format_ip_batch_sse()` does
+ * with what's left over, or all of it without SSSE3.
+ * @returns the number of bytes written
+ */
+static size_t
+format_ip_batch_swar(const uint32_t *ips, size_t count, char *out, char separator) {
+    size_t n = 0;
+    size_t i;
+
+    for (i=0; i<count; i++) {
+        n += format_ip_swar(ips[i], out + n);
+        out[n++] = separator;
+    }
+    return n;
+}
+
+/*
+ * ---- sse ----
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSSE3 __attribute__((target("ssse3")))
+
+/*
+ * The shuffle masks, by the lengths of the octets. The source register
+ * for an address is its four hundreds digits, then tens, then ones,
+ * each in little-endian order (last octet first), then '.' and the
+ * separator.
+ */
+static unsigned char shuffles[81][16];
+
+static void
+shuffles_init(void) {
+    unsigned code;
+
+    for (code=0; code<81; code++) {
+        unsigned n = 0;
+        unsigned k;
+
+        memset(shuffles[code], 0x80, 16);
+        for (k=0; k<4; k++) {
+            /* Octet k of the address is byte 3-k of the little-endian word */
+            unsigned length = (code / (k == 0 ? 27 : k == 1 ? 9 : k == 2 ? 3 : 1)) % 3 + 1;
+            unsigned b = 3 - k;
+            if (length >= 3)
+                shuffles[code][n++] = (unsigned char)b;
+            if (length >= 2)
+                shuffles[code][n++] = (unsigned char)(4 + b);
+            shuffles[code][n++] = (unsigned char)(8 + b);
+            shuffles[code][n++] = (unsigned char)(k < 3 ? 12 : 13);
+        }
+    }
+}
+
+/**
+ * Formats `count` addresses, each followed by `separator`, four at a
+ * time. `out` needs room for 16 bytes per address.
+ * @returns the number of bytes written
+ */
+SSSE3 size_t
+format_ip_batch_sse(const uint32_t *ips, size_t count, char *out, char separator) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i digit0 = _mm_set1_epi8('0');
+    const __m128i ends = _mm_set1_epi32((int)((unsigned char)'.' | (unsigned)(unsigned char)separator << 8));
+    size_t n = 0;
+    size_t i;
+
+    for (i=0; i+4<=count; i+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(ips + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i h_lo = _mm_srli_epi16(_mm_mullo_epi16(lo, _mm_set1_epi16(41)), 12);
+        __m128i h_hi = _mm_srli_epi16(_mm_mullo_epi16(hi, _mm_set1_epi16(41)), 12);
+        __m128i r_lo = _mm_sub_epi16(lo, _mm_mullo_epi16(h_lo, _mm_set1_epi16(100)));
+        __m128i r_hi = _mm_sub_epi16(hi, _mm_mullo_epi16(h_hi, _mm_set1_epi16(100)));
+        __m128i t_lo = _mm_srli_epi16(_mm_mullo_epi16(r_lo, _mm_set1_epi16(103)), 10);
+        __m128i t_hi = _mm_srli_epi16(_mm_mullo_epi16(r_hi, _mm_set1_epi16(103)), 10);
+        __m128i o_lo = _mm_sub_epi16(r_lo, _mm_mullo_epi16(t_lo, _mm_set1_epi16(10)));
+        __m128i o_hi = _mm_sub_epi16(r_hi, _mm_mullo_epi16(t_hi, _mm_set1_epi16(10)));
+        /* Lengths minus 1: 0, 1, or 2 */
+        __m128i l_lo = _mm_sub_epi16(zero, _mm_add_epi16(_mm_cmpgt_epi16(lo, _mm_set1_epi16(9)),
+                                                           _mm_cmpgt_epi16(lo, _mm_set1_epi16(99))));
+        __m128i l_hi = _mm_sub_epi16(zero, _mm_add_epi16(_mm_cmpgt_epi16(hi, _mm_set1_epi16(9)),
+                                                           _mm_cmpgt_epi16(hi, _mm_set1_epi16(99))));
+        __m128i hundreds = _mm_add_epi8(_mm_packus_epi16(h_lo, h_hi), digit0);
+        __m128i tens = _mm_add_epi8(_mm_packus_epi16(t_lo, t_hi), digit0);
+        __m128i ones = _mm_add_epi8(_mm_packus_epi16(o_lo, o_hi), digit0);
+        __m128i lengths = _mm_packus_epi16(l_lo, l_hi);
+        __m128i ht_lo = _mm_unpacklo_epi32(hundreds, tens);
+        __m128i ht_hi = _mm_unpackhi_epi32(hundreds, tens);
+        __m128i oe_lo = _mm_unpacklo_epi32(ones, ends);
+        __m128i oe_hi = _mm_unpackhi_epi32(ones, ends);
+        __m128i src[4];
+        uint32_t l[4];
+        int k;
+
+        src[0] = _mm_unpacklo_epi64(ht_lo, oe_lo);
+        src[1] = _mm_unpackhi_epi64(ht_lo, oe_lo);
+        src[2] = _mm_unpacklo_epi64(ht_hi, oe_hi);
+        src[3] = _mm_unpackhi_epi64(ht_hi, oe_hi);
+        _mm_storeu_si128((__m128i *)l, lengths);
+
+        for (k=0; k<4; k++) {
+            /* Octets weighted 27, 9, 3, 1 from the first, in the top
+             * byte of a multiply, and their total length */
+            uint32_t code = (l[k] * 0x0103091Bu) >> 24;
+            uint32_t length = ((l[k] * 0x01010101u) >> 24) + 8;
+            __m128i mask = _mm_loadu_si128((const __m128i *)shuffles[code]);
+
+            _mm_storeu_si128((__m128i *)(out + n), _mm_shuffle_epi8(src[k], mask));
+            n += length;
+        }
+    }
+    return n + format_ip_batch_swar(ips + i, count - i, out + n, separator);
+}
+#else
+size_t
+format_ip_batch_sse(const uint32_t *ips, size_t count, char *out, char separator) {
+    return format_ip_batch_swar(ips, count, out, separator);
+}
+#endif
+
+/**
+ * Fills in the tables. Must be called before using the formatters.
+ */
+void
+format_ip_init(void) {
+    table_init();
+#if defined(__x86_64__) || defined(__i386__)
+    shuffles_init();
+#endif
+}
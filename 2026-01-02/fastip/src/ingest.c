@@ -0,0 +1,611 @@
+/*
+    Double-buffered input from a pipe or any file descriptor
+
+ A file can be `mmap()`ed and parsed in place, but a pipe (like
+ `zcat logs.gz | fastip --stdin`) has to be `read()`. Reading and
+ parsing one after the other, the parser sits idle during every
+ `read()`, and the process on the other end of the pipe sits idle
+ while we parse.
+
+ So this has two big buffers. A reader thread fills one while the
+ caller's thread parses the other, then they swap. The buffers are
+ filled completely (a pipe returns 64-KB at a time) so that the
+ handoff between threads is rare.
+
+ An address can straddle the end of a buffer. The streaming parser
+ leaves it unconsumed, and those few bytes are copied to the space
+ reserved just before the start of the next buffer, so they join up
+ with the rest of the address without moving anything else. A token
+ too long to fit there is too long to be an address. Only its last
+ bytes are kept, behind an `x`, so that it's still one token that
+ isn't an address, and the streamer drops it once it sees the end of
+ it. That way it's the streamer's own idea of where a token ends
+ (whitespace, or the end of a word for `--parser extract`) that
+ counts, not ours.
+
+ On Linux there's also an `io_uring` version for regular files, which
+ keeps several reads in flight at once, so that the drive is always
+ busy while we parse. It uses the raw system calls, so it doesn't
+ need `liburing`. The buffers and the file are registered with the
+ ring, so the kernel doesn't have to map them on every read. When
+ `io_uring` isn't there (an old kernel, or blocked by seccomp in a
+ container), or the input isn't a regular file, it falls back to the
+ `read()` version.
+ */
+#define _DEFAULT_SOURCE /* for syscall() */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef size_t (*STREAMER)(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+typedef void (*SINK)(const uint32_t *addresses, size_t count, void *arg);
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+enum {
+    CHUNK_SIZE = 4 * 1024 * 1024,
+    HEADROOM = 64,       /* room for a carried-over address */
+    OUT_MAX = 65536,
+};
+
+struct buffer {
+    char *mem;      /* HEADROOM bytes, then the data */
+    size_t length;  /* bytes of data */
+    int full;       /* filled by the reader, not yet parsed */
+    int eof;        /* this is the last buffer */
+    int error;      /* errno from `read()` */
+};
+
+struct ingest {
+    int fd;
+    struct buffer buffers[2];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/**
+ * Fills `p` from the descriptor, until it's full or at the end of the
+ * input. Sets `*error` if `read()` fails.
+ */
+static size_t
+read_fully(int fd, char *p, size_t size, int *error) {
+    size_t length = 0;
+
+    while (length < size) {
+        ssize_t n = read(fd, p + length, size - length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            *error = errno;
+            break;
+        }
+        if (n == 0)
+            break;
+        length += (size_t)n;
+    }
+    return length;
+}
+
+/**
+ * The reader thread: fills the buffers in turn, waiting for the parser
+ * to finish with each before filling it again.
+ */
+static void *
+reader_thread(void *arg) {
+    struct ingest *in = arg;
+    int k = 0;
+
+    for (;;) {
+        struct buffer *b = &in->buffers[k];
+        int error = 0;
+        size_t length;
+
+        pthread_mutex_lock(&in->lock);
+        while (b->full)
+            pthread_cond_wait(&in->changed, &in->lock);
+        pthread_mutex_unlock(&in->lock);
+
+        length = read_fully(in->fd, b->mem + HEADROOM, CHUNK_SIZE, &error);
+
+        pthread_mutex_lock(&in->lock);
+        b->length = length;
+        b->eof = (length < CHUNK_SIZE);
+        b->error = error;
+        b->full = 1;
+        pthread_cond_broadcast(&in->changed);
+        pthread_mutex_unlock(&in->lock);
+
+        if (b->eof)
+            break;
+        k ^= 1;
+    }
+    return NULL;
+}
+
+/*
+ * What's carried from one chunk of input to the next.
+ */
+struct parser {
+    STREAMER streamer;
+    SINK sink;
+    void *arg;
+    uint32_t *out;
+    char carry[HEADROOM];
+    size_t carry_length;
+    long long count;
+};
+
+/**
+ * Parses the next chunk of input, at `data`, which must have
+ * HEADROOM bytes free before it. If it's the last one, `eof` is set,
+ * and there must be a byte free after it for a final separator.
+ * Afterwards the buffer can be reused.
+ */
+static void
+parse_chunk(struct parser *ps, char *data, size_t length, int eof) {
+    size_t offset;
+    char *start;
+
+    /* Join the carried-over bytes to the start of this chunk */
+    start = data - ps->carry_length;
+    memcpy(start, ps->carry, ps->carry_length);
+    if (eof)
+        data[length++] = '\n';   /* the last address needs a separator */
+    length = (size_t)(data + length - start);
+
+    offset = 0;
+    while (offset < length) {
+        size_t consumed;
+        size_t n = ps->streamer(start + offset, length - offset, ps->out, OUT_MAX, &consumed);
+        if (n)
+            ps->sink(ps->out, n, ps->arg);
+        ps->count += (long long)n;
+        if (consumed == 0)
+            break;
+        offset += consumed;
+    }
+
+    /* Save what's left before the buffer is reused */
+    ps->carry_length = length - offset;
+    if (ps->carry_length > sizeof(ps->carry)) {
+        /* Too long to be an address: keep the end, marked as junk */
+        offset = length - (sizeof(ps->carry) - 1);
+        ps->carry_length = sizeof(ps->carry);
+        ps->carry[0] = 'x';
+        memcpy(ps->carry + 1, start + offset, ps->carry_length - 1);
+    } else
+        memcpy(ps->carry, start + offset, ps->carry_length);
+}
+
+static void
+parser_init(struct parser *ps, STREAMER streamer, SINK sink, void *arg) {
+    memset(ps, 0, sizeof(*ps));
+    ps->streamer = streamer;
+    ps->sink = sink;
+    ps->arg = arg;
+    ps->out = malloc(OUT_MAX * sizeof(*ps->out));
+}
+
+/**
+ * Reads `fd` to the end, parsing the addresses in it with `streamer`
+ * and handing them to `sink()` in batches. Sets `*bytes` to the number
+ * of bytes read.
+ * @returns the number of addresses, or -1 on a read error (with
+ * `errno` set), after passing on everything before it
+ */
+long long
+parse_ip_fd(int fd, STREAMER streamer, SINK sink, void *arg, unsigned long long *bytes) {
+    struct ingest in;
+    struct parser ps;
+    pthread_t reader;
+    int error = 0;
+    int k = 0;
+
+    memset(&in, 0, sizeof(in));
+    in.fd = fd;
+    in.buffers[0].mem = malloc(HEADROOM + CHUNK_SIZE + 1);
+    in.buffers[1].mem = malloc(HEADROOM + CHUNK_SIZE + 1);
+    pthread_mutex_init(&in.lock, NULL);
+    pthread_cond_init(&in.changed, NULL);
+    parser_init(&ps, streamer, sink, arg);
+    *bytes = 0;
+    pthread_create(&reader, NULL, reader_thread, &in);
+
+    for (;;) {
+        struct buffer *b = &in.buffers[k];
+        int eof;
+
+        pthread_mutex_lock(&in.lock);
+        while (!b->full)
+            pthread_cond_wait(&in.changed, &in.lock);
+        pthread_mutex_unlock(&in.lock);
+        eof = b->eof;
+        error = b->error;
+        *bytes += b->length;
+
+        parse_chunk(&ps, b->mem + HEADROOM, b->length, eof);
+
+        pthread_mutex_lock(&in.lock);
+        b->full = 0;
+        pthread_cond_broadcast(&in.changed);
+        pthread_mutex_unlock(&in.lock);
+
+        if (eof)
+            break;
+        k ^= 1;
+    }
+
+    pthread_join(reader, NULL);
+    pthread_cond_destroy(&in.changed);
+    pthread_mutex_destroy(&in.lock);
+    free(in.buffers[0].mem);
+    free(in.buffers[1].mem);
+    free(ps.out);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return ps.count;
+}
+
+#if HAVE_IO_URING
+enum {
+    URING_BUFFERS = 4,  /* reads in flight */
+};
+
+/*
+ * The ring, mapped from the kernel.
+ */
+struct uring {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned to_submit;
+};
+
+/*
+ * One read, filling one of the buffers with one chunk of the file.
+ */
+struct slot {
+    char *mem;
+    uint64_t offset;    /* in the file */
+    size_t want;
+    size_t got;
+    int done;
+    int error;          /* errno from the read */
+};
+
+static int
+uring_init(struct uring *r, unsigned entries) {
+    struct io_uring_params p;
+    char *sq;
+
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return -1;
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size)
+            r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = 0;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED)
+        goto fail;
+    if (r->cq_ring_size) {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED)
+            goto fail;
+    } else
+        r->cq_ring = r->sq_ring;
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto fail;
+
+    sq = r->sq_ring;
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ring + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ring + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring + p.cq_off.cqes);
+    return 0;
+
+fail:
+    close(r->fd);
+    return -1;
+}
+
+static void
+uring_free(struct uring *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd);
+}
+
+/**
+ * Queues a read of the rest of slot `k`'s chunk. It's sent to the
+ * kernel by the next `uring_enter()`.
+ */
+static void
+uring_read(struct uring *r, struct slot *slot, unsigned k, int fixed_buffers, int fixed_file, int fd) {
+    unsigned tail = *r->sq_tail;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->flags = fixed_file ? IOSQE_FIXED_FILE : 0;
+    sqe->fd = fixed_file ? 0 : fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->mem + HEADROOM + slot->got);
+    sqe->len = (unsigned)(slot->want - slot->got);
+    sqe->off = slot->offset + slot->got;
+    sqe->buf_index = (uint16_t)k;
+    sqe->user_data = k;
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+}
+
+/**
+ * Submits the queued reads, and if `wait` is set, waits for at least
+ * one to finish.
+ */
+static int
+uring_enter(struct uring *r, int wait) {
+    long n;
+
+    do {
+        n = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait ? 1 : 0,
+                    wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return -1;
+    r->to_submit -= (unsigned)n;
+    return 0;
+}
+
+/**
+ * Checks that the kernel has IORING_OP_READ, which came in Linux 5.6.
+ * Before that the ring can be set up, but every read fails with
+ * -EINVAL. Asking for a probe fails the same way on those kernels.
+ */
+static int
+uring_can_read(struct uring *r) {
+    enum { MAX_OPS = 256 };
+    struct io_uring_probe *probe;
+    int ok;
+
+    probe = calloc(1, sizeof(*probe) + MAX_OPS * sizeof(probe->ops[0]));
+    ok = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, MAX_OPS) == 0
+         && probe->last_op >= IORING_OP_READ
+         && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+/**
+ * Checks if io_uring can be used at all.
+ */
+int
+parse_ip_uring_available(void) {
+    struct uring r;
+    int ok;
+
+    if (uring_init(&r, URING_BUFFERS) != 0)
+        return 0;
+    ok = uring_can_read(&r);
+    uring_free(&r);
+    return ok;
+}
+
+/**
+ * Same as `parse_ip_fd()`, but reads with io_uring, with several reads
+ * in flight, handing the chunks to the parser in order as they
+ * arrive. Falls back to `parse_ip_fd()` if that can't be done.
+ */
+long long
+parse_ip_uring(int fd, STREAMER streamer, SINK sink, void *arg, unsigned long long *bytes) {
+    struct slot slots[URING_BUFFERS];
+    struct iovec iov[URING_BUFFERS];
+    struct parser ps;
+    struct uring r;
+    struct stat st;
+    uint64_t chunks, next, seq;
+    unsigned inflight = 0;
+    int fixed_buffers, fixed_file;
+    int error = 0;
+    unsigned k;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || uring_init(&r, URING_BUFFERS * 2) != 0)
+        return parse_ip_fd(fd, streamer, sink, arg, bytes);
+    if (!uring_can_read(&r)) {
+        uring_free(&r);
+        return parse_ip_fd(fd, streamer, sink, arg, bytes);
+    }
+
+    for (k=0; k<URING_BUFFERS; k++) {
+        slots[k].mem = malloc(HEADROOM + CHUNK_SIZE + 1);
+        iov[k].iov_base = slots[k].mem;
+        iov[k].iov_len = HEADROOM + CHUNK_SIZE;
+    }
+
+    /* These can fail, for example if the buffers are more than we're
+     * allowed to lock in memory. The reads work without them. */
+    fixed_buffers = syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS,
+                            iov, URING_BUFFERS) == 0;
+    fixed_file = syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_FILES, &fd, 1) == 0;
+
+    parser_init(&ps, streamer, sink, arg);
+    *bytes = 0;
+    chunks = ((uint64_t)st.st_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    /* Start the first reads */
+    for (next=0; next<chunks && next<URING_BUFFERS; next++) {
+        struct slot *slot = &slots[next];
+        slot->offset = next * CHUNK_SIZE;
+        slot->want = (size_t)((uint64_t)st.st_size - slot->offset < CHUNK_SIZE
+                              ? (uint64_t)st.st_size - slot->offset : CHUNK_SIZE);
+        slot->got = 0;
+        slot->done = 0;
+        slot->error = 0;
+        uring_read(&r, slot, (unsigned)next, fixed_buffers, fixed_file, fd);
+        inflight++;
+    }
+    uring_enter(&r, 0);
+
+    for (seq=0; seq<chunks && !error; seq++) {
+        struct slot *slot = &slots[seq % URING_BUFFERS];
+        int eof = (seq + 1 == chunks);
+
+        /* Wait for this chunk, collecting any others that finish */
+        while (!slot->done) {
+            unsigned head, tail;
+
+            if (uring_enter(&r, 1) != 0) {
+                error = errno;
+                break;
+            }
+            head = *r.cq_head;
+            tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+                unsigned j = (unsigned)cqe->user_data;
+                struct slot *s = &slots[j];
+
+                inflight--;
+                if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+                    uring_read(&r, s, j, fixed_buffers, fixed_file, fd);
+                    inflight++;
+                } else if (cqe->res < 0) {
+                    s->error = -cqe->res;
+                    s->done = 1;
+                } else if (cqe->res == 0) {
+                    s->done = 1;    /* the file got shorter */
+                } else {
+                    s->got += (size_t)cqe->res;
+                    if (s->got < s->want) {
+                        uring_read(&r, s, j, fixed_buffers, fixed_file, fd);
+                        inflight++;
+                    } else
+                        s->done = 1;
+                }
+            }
+            __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+        }
+        if (error)
+            break;
+        /* A failed read ends the input, like a short one, so what was
+         * read before it is still parsed. A later chunk's failure
+         * doesn't matter until we get to it. */
+        if (slot->error)
+            error = slot->error;
+        if (slot->got < slot->want)
+            eof = 1;
+
+        *bytes += slot->got;
+        parse_chunk(&ps, slot->mem + HEADROOM, slot->got, eof);
+        if (eof)
+            break;
+
+        /* Reuse the buffer for the next chunk to read */
+        if (next < chunks) {
+            slot->offset = next * CHUNK_SIZE;
+            slot->want = (size_t)((uint64_t)st.st_size - slot->offset < CHUNK_SIZE
+                                  ? (uint64_t)st.st_size - slot->offset : CHUNK_SIZE);
+            slot->got = 0;
+            slot->done = 0;
+            slot->error = 0;
+            uring_read(&r, slot, (unsigned)(next % URING_BUFFERS), fixed_buffers, fixed_file, fd);
+            inflight++;
+            next++;
+            uring_enter(&r, 0);
+        }
+    }
+    if (chunks == 0)
+        parse_chunk(&ps, slots[0].mem + HEADROOM, 0, 1);
+
+    /* Don't free buffers the kernel is still reading into */
+    while (inflight) {
+        unsigned head, tail;
+        if (uring_enter(&r, 1) != 0)
+            break;
+        head = *r.cq_head;
+        tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        inflight -= tail - head;
+        __atomic_store_n(r.cq_head, tail, __ATOMIC_RELEASE);
+    }
+
+    uring_free(&r);
+    for (k=0; k<URING_BUFFERS; k++)
+        free(slots[k].mem);
+    free(ps.out);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return ps.count;
+}
+#else
+int
+parse_ip_uring_available(void) {
+    return 0;
+}
+
+long long
+parse_ip_uring(int fd, STREAMER streamer, SINK sink, void *arg, unsigned long long *bytes) {
+    return parse_ip_fd(fd, streamer, sink, arg, bytes);
+}
+#endif
+
+#else
+int
+parse_ip_uring_available(void) {
+    return 0;
+}
+
+long long
+parse_ip_uring(int fd, STREAMER streamer, SINK sink, void *arg, unsigned long long *bytes) {
+    return parse_ip_fd(fd, streamer, sink, arg, bytes);
+}
+
+long long
+parse_ip_fd(int fd, STREAMER streamer, SINK sink, void *arg, unsigned long long *bytes) {
+    (void)fd; (void)streamer; (void)sink; (void)arg;
+    *bytes = 0;
+    return -1;
+}
+#endif
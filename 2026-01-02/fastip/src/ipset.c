@@ -0,0 +1,672 @@
+/*
+    Sets of addresses, for membership checks
+
+ Parsed addresses often end up checked against a list: is this one in
+ the exclude list, or the blocklist? Which way of storing the list is
+ fastest depends on its size, so there are three, behind one API:
+
+ - `IPSET_BITMAP`: one bit for every possible address, 512-MB. A
+   lookup is one load, but the pages are only touched (and so only
+   use memory) where there are addresses, and a big random list
+   touches them all.
+ - `IPSET_RANGES`: a sorted array of disjoint ranges, with adjacent
+   ones merged, so a list of whole subnets stays tiny. A lookup is a
+   binary search with no branches: the next half is picked with a
+   conditional move, so there are no mispredictions, and lookups are
+   done 8 at a time in lockstep, so the loads of different searches
+   overlap instead of waiting for each other.
+ - `IPSET_ROARING`: two levels, like Roaring bitmaps. The top 16 bits
+   index a table of containers for the bottom 16. A container with
+   up to 4096 addresses is a sorted array of them, 2 bytes each, and
+   one with more is a 65536-bit (8-KB) bitmap, which is smaller. It's
+   compact for sparse lists, and only ever 2 loads for a lookup.
+
+ Addresses are added in bulk, as they come from a parser, or as
+ ranges, as they come from a list of CIDR blocks. Sets of any kind can
+ be merged into one another. Lookups are in batches, which lets each
+ kind overlap the memory accesses of several lookups.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t ip_radix_sort(uint32_t *a, size_t n, uint32_t *tmp, unsigned digit_bits, unsigned threads, int unique);
+
+enum ipset_kind {
+    IPSET_BITMAP,
+    IPSET_RANGES,
+    IPSET_ROARING,
+};
+
+enum {
+    ARRAY_MAX = 4096,           /* addresses before a container is a bitmap */
+    LOCKSTEP = 8,               /* searches done together */
+};
+
+/* A roaring container, for the addresses sharing the top 16 bits */
+struct container {
+    uint32_t cardinality;
+    uint32_t capacity;
+    uint16_t *array;            /* when there are up to ARRAY_MAX */
+    uint64_t *bitmap;           /* 1024 words, when there are more */
+};
+
+struct ipset {
+    enum ipset_kind kind;
+
+    /* IPSET_BITMAP */
+    uint64_t *bits;
+
+    /* IPSET_RANGES, with the firsts apart so a search only reads them */
+    uint32_t *firsts;
+    uint32_t *lasts;
+    size_t count;
+    size_t capacity;
+
+    /* IPSET_ROARING */
+    struct container **containers;
+    size_t ncontainers;
+};
+
+/* A growable list of ranges, for moving them between kinds */
+struct runs {
+    uint32_t *firsts;
+    uint32_t *lasts;
+    size_t count;
+    size_t capacity;
+};
+
+static void
+runs_add(struct runs *r, uint32_t first, uint32_t last) {
+    if (r->count && (r->lasts[r->count - 1] == 0xFFFFFFFF || r->lasts[r->count - 1] + 1 >= first)) {
+        if (r->lasts[r->count - 1] < last)
+            r->lasts[r->count - 1] = last;
+        return;
+    }
+    if (r->count == r->capacity) {
+        r->capacity = r->capacity * 2 + 64;
+        r->firsts = realloc(r->firsts, r->capacity * sizeof(*r->firsts));
+        r->lasts = realloc(r->lasts, r->capacity * sizeof(*r->lasts));
+    }
+    r->firsts[r->count] = first;
+    r->lasts[r->count] = last;
+    r->count++;
+}
+
+static void
+runs_free(struct runs *r) {
+    free(r->firsts);
+    free(r->lasts);
+}
+
+/**
+ * Turns sorted, unique addresses into runs.
+ */
+static void
+runs_from_sorted(struct runs *r, const uint32_t *a, size_t n) {
+    size_t i = 0;
+
+    while (i < n) {
+        size_t j = i;
+        while (j + 1 < n && a[j + 1] == a[j] + 1)
+            j++;
+        runs_add(r, a[i], a[j]);
+        i = j + 1;
+    }
+}
+
+/**
+ * Sorts a copy of the addresses, without duplicates.
+ * @returns the copy, to be freed
+ */
+static uint32_t *
+sorted_copy(const uint32_t *addresses, size_t *count) {
+    uint32_t *a = malloc(*count * sizeof(*a) + 1);
+    uint32_t *tmp = malloc(*count * sizeof(*tmp) + 1);
+
+    memcpy(a, addresses, *count * sizeof(*a));
+    *count = ip_radix_sort(a, *count, tmp, 11, 1, 1);
+    free(tmp);
+    return a;
+}
+
+/*
+ * ---- IPSET_BITMAP ----
+ */
+
+static void
+bitmap_set_range(uint64_t *bits, uint64_t first, uint64_t last) {
+    uint64_t lo = first >> 6;
+    uint64_t hi = last >> 6;
+    uint64_t lo_mask = ~0ULL << (first & 63);
+    uint64_t hi_mask = ~0ULL >> (63 - (last & 63));
+    uint64_t i;
+
+    if (lo == hi) {
+        bits[lo] |= lo_mask & hi_mask;
+        return;
+    }
+    bits[lo] |= lo_mask;
+    for (i=lo+1; i<hi; i++)
+        bits[i] = ~0ULL;
+    bits[hi] |= hi_mask;
+}
+
+/**
+ * Finds the runs of set bits in a bitmap of `nbits` bits, adding
+ * `base` to each.
+ */
+static void
+bitmap_runs(struct runs *r, const uint64_t *bits, size_t nbits, uint32_t base) {
+    size_t words = nbits / 64;
+    size_t i;
+
+    for (i=0; i<words; i++) {
+        uint64_t w = bits[i];
+        while (w) {
+            unsigned start = (unsigned)__builtin_ctzll(w);
+            uint64_t rest = ~(w >> start);
+            unsigned length = rest ? (unsigned)__builtin_ctzll(rest) : 64 - start;
+            uint32_t first = base + (uint32_t)(i * 64 + start);
+            runs_add(r, first, first + length - 1);
+            w = start + length >= 64 ? 0 : w & (~0ULL << (start + length));
+        }
+    }
+}
+
+/*
+ * ---- IPSET_RANGES ----
+ */
+
+/**
+ * Replaces the set's ranges with their union with `r`.
+ */
+static void
+ranges_union(struct ipset *s, const struct runs *r) {
+    struct runs u = {NULL, NULL, 0, 0};
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < s->count || j < r->count) {
+        if (j == r->count || (i < s->count && s->firsts[i] <= r->firsts[j])) {
+            runs_add(&u, s->firsts[i], s->lasts[i]);
+            i++;
+        } else {
+            runs_add(&u, r->firsts[j], r->lasts[j]);
+            j++;
+        }
+    }
+    free(s->firsts);
+    free(s->lasts);
+    s->firsts = u.firsts;
+    s->lasts = u.lasts;
+    s->count = u.count;
+    s->capacity = u.capacity;
+}
+
+/**
+ * Looks up a batch of up to LOCKSTEP addresses together. Every search
+ * takes the same number of steps, so they go round the loop together.
+ */
+static size_t
+ranges_lookup(const struct ipset *s, const uint32_t *x, size_t n, uint8_t *results) {
+    const uint32_t *base[LOCKSTEP];
+    size_t hits = 0;
+    size_t len = s->count;
+    size_t k;
+
+    for (k=0; k<n; k++)
+        base[k] = s->firsts;
+    while (len > 1) {
+        size_t half = len / 2;
+        for (k=0; k<n; k++)
+            base[k] = base[k][half] <= x[k] ? base[k] + half : base[k];
+        len -= half;
+    }
+    for (k=0; k<n; k++) {
+        size_t i = (size_t)(base[k] - s->firsts);
+        uint8_t hit = (s->firsts[i] <= x[k]) & (x[k] <= s->lasts[i]);
+        if (results)
+            results[k] = hit;
+        hits += hit;
+    }
+    return hits;
+}
+
+/*
+ * ---- IPSET_ROARING ----
+ */
+
+static struct container *
+container_get(struct ipset *s, uint32_t high) {
+    struct container *c = s->containers[high];
+
+    if (c == NULL) {
+        c = calloc(1, sizeof(*c));
+        s->containers[high] = c;
+        s->ncontainers++;
+    }
+    return c;
+}
+
+static void
+container_to_bitmap(struct container *c) {
+    uint32_t i;
+
+    if (c->bitmap)
+        return;
+    c->bitmap = calloc(1024, sizeof(*c->bitmap));
+    for (i=0; i<c->cardinality; i++)
+        c->bitmap[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+    free(c->array);
+    c->array = NULL;
+    c->capacity = 0;
+}
+
+static void
+container_recount(struct container *c) {
+    uint32_t count = 0;
+    size_t i;
+
+    for (i=0; i<1024; i++)
+        count += (uint32_t)__builtin_popcountll(c->bitmap[i]);
+    c->cardinality = count;
+}
+
+/**
+ * Adds sorted, unique values to a container.
+ */
+static void
+container_add(struct container *c, const uint16_t *values, size_t n) {
+    uint16_t *merged;
+    size_t capacity = c->cardinality + n;
+    size_t i = 0, j = 0, k = 0;
+
+    if (!c->bitmap && c->cardinality + n > ARRAY_MAX)
+        container_to_bitmap(c);
+    if (c->bitmap) {
+        for (i=0; i<n; i++)
+            c->bitmap[values[i] >> 6] |= 1ULL << (values[i] & 63);
+        container_recount(c);
+        return;
+    }
+
+    merged = malloc(capacity * sizeof(*merged));
+    while (i < c->cardinality || j < n) {
+        uint16_t v;
+        if (j == n || (i < c->cardinality && c->array[i] <= values[j]))
+            v = c->array[i++];
+        else
+            v = values[j++];
+        if (k == 0 || merged[k - 1] != v)
+            merged[k++] = v;
+    }
+    free(c->array);
+    c->array = merged;
+    c->cardinality = (uint32_t)k;
+    c->capacity = (uint32_t)capacity;
+    if (c->cardinality > ARRAY_MAX)
+        container_to_bitmap(c);
+}
+
+/**
+ * Adds runs, which must all be in this container, sorted.
+ */
+static void
+container_add_runs(struct container *c, const uint32_t *firsts, const uint32_t *lasts, size_t n) {
+    size_t total = 0;
+    size_t i;
+
+    for (i=0; i<n; i++)
+        total += (size_t)(lasts[i] - firsts[i]) + 1;
+
+    if (!c->bitmap && c->cardinality + total <= ARRAY_MAX) {
+        uint16_t *values = malloc(total * sizeof(*values) + 1);
+        size_t k = 0;
+        for (i=0; i<n; i++) {
+            uint32_t length = lasts[i] - firsts[i] + 1;
+            uint32_t x;
+            for (x=0; x<length; x++)
+                values[k++] = (uint16_t)(firsts[i] + x);
+        }
+        container_add(c, values, k);
+        free(values);
+        return;
+    }
+
+    container_to_bitmap(c);
+    for (i=0; i<n; i++)
+        bitmap_set_range(c->bitmap, firsts[i] & 0xFFFF, lasts[i] & 0xFFFF);
+    container_recount(c);
+}
+
+static int
+container_contains(const struct container *c, uint16_t x) {
+    const uint16_t *base;
+    size_t len;
+
+    if (c->bitmap)
+        return (int)(c->bitmap[x >> 6] >> (x & 63)) & 1;
+    if (c->cardinality == 0)
+        return 0;
+    base = c->array;
+    len = c->cardinality;
+    while (len > 1) {
+        size_t half = len / 2;
+        base = base[half] <= x ? base + half : base;
+        len -= half;
+    }
+    return *base == x;
+}
+
+/**
+ * Adds runs to a roaring set, splitting any that cross a container
+ * edge, and adding each container's share at once.
+ */
+static void
+roaring_add_runs(struct ipset *s, const struct runs *r) {
+    struct runs split = {NULL, NULL, 0, 0};
+    size_t i = 0;
+
+    /* No runs across containers, so they can't be merged here */
+    for (i=0; i<r->count; i++) {
+        uint64_t first = r->firsts[i];
+        uint64_t last = r->lasts[i];
+        while (first <= last) {
+            uint64_t end = (first | 0xFFFF) < last ? (first | 0xFFFF) : last;
+            if (split.count == split.capacity) {
+                split.capacity = split.capacity * 2 + 64;
+                split.firsts = realloc(split.firsts, split.capacity * sizeof(*split.firsts));
+                split.lasts = realloc(split.lasts, split.capacity * sizeof(*split.lasts));
+            }
+            split.firsts[split.count] = (uint32_t)first;
+            split.lasts[split.count] = (uint32_t)end;
+            split.count++;
+            first = end + 1;
+        }
+    }
+
+    i = 0;
+    while (i < split.count) {
+        uint32_t high = split.firsts[i] >> 16;
+        size_t j = i;
+        while (j < split.count && split.firsts[j] >> 16 == high)
+            j++;
+        container_add_runs(container_get(s, high), split.firsts + i, split.lasts + i, j - i);
+        i = j;
+    }
+    runs_free(&split);
+}
+
+/*
+ * ---- The API ----
+ */
+
+/**
+ * Creates an empty set of the given kind.
+ * @returns NULL if out of memory
+ */
+struct ipset *
+ipset_create(int kind) {
+    struct ipset *s = calloc(1, sizeof(*s));
+
+    if (s == NULL)
+        return NULL;
+    s->kind = (enum ipset_kind)kind;
+    switch (s->kind) {
+    case IPSET_BITMAP:
+        /* 512-MB, a bit per address. At this size calloc() gets fresh
+         * zeroed pages from the kernel, and a page only takes memory
+         * once an address in its 32K is added. */
+        s->bits = calloc((size_t)1 << 26, sizeof(*s->bits));
+        if (s->bits == NULL) {
+            free(s);
+            return NULL;
+        }
+        break;
+    case IPSET_RANGES:
+        break;
+    case IPSET_ROARING:
+        s->containers = calloc(65536, sizeof(*s->containers));
+        if (s->containers == NULL) {
+            free(s);
+            return NULL;
+        }
+        break;
+    }
+    return s;
+}
+
+void
+ipset_free(struct ipset *s) {
+    size_t i;
+
+    if (s == NULL)
+        return;
+    if (s->containers) {
+        for (i=0; i<65536; i++) {
+            if (s->containers[i]) {
+                free(s->containers[i]->array);
+                free(s->containers[i]->bitmap);
+                free(s->containers[i]);
+            }
+        }
+    }
+    free(s->containers);
+    free(s->firsts);
+    free(s->lasts);
+    free(s->bits);
+    free(s);
+}
+
+/**
+ * Adds the ranges of addresses in `r` to any kind of set.
+ */
+static void
+add_runs(struct ipset *s, const struct runs *r) {
+    size_t i;
+
+    switch (s->kind) {
+    case IPSET_BITMAP:
+        for (i=0; i<r->count; i++)
+            bitmap_set_range(s->bits, r->firsts[i], r->lasts[i]);
+        break;
+    case IPSET_RANGES:
+        ranges_union(s, r);
+        break;
+    case IPSET_ROARING:
+        roaring_add_runs(s, r);
+        break;
+    }
+}
+
+/**
+ * Adds a batch of addresses, such as a parser's output, in any order
+ * and with duplicates.
+ */
+void
+ipset_insert(struct ipset *s, const uint32_t *addresses, size_t count) {
+    struct runs r = {NULL, NULL, 0, 0};
+    uint32_t *a;
+    size_t i = 0;
+
+    if (s->kind == IPSET_BITMAP) {
+        for (i=0; i<count; i++)
+            s->bits[addresses[i] >> 6] |= 1ULL << (addresses[i] & 63);
+        return;
+    }
+
+    a = sorted_copy(addresses, &count);
+    if (s->kind == IPSET_RANGES) {
+        runs_from_sorted(&r, a, count);
+        ranges_union(s, &r);
+        runs_free(&r);
+    } else {
+        uint16_t *values = malloc(65536 * sizeof(*values));
+        while (i < count) {
+            uint32_t high = a[i] >> 16;
+            size_t n = 0;
+            while (i < count && a[i] >> 16 == high)
+                values[n++] = (uint16_t)a[i++];
+            container_add(container_get(s, high), values, n);
+        }
+        free(values);
+    }
+    free(a);
+}
+
+static int
+compare_ranges(const void *lhs, const void *rhs) {
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Adds a batch of ranges, `firsts[i]` to `lasts[i]` inclusive, such
+ * as the subnets from a CIDR list, in any order and overlapping. A
+ * range that runs backwards is skipped.
+ */
+void
+ipset_insert_ranges(struct ipset *s, const uint32_t *firsts, const uint32_t *lasts, size_t count) {
+    struct runs r = {NULL, NULL, 0, 0};
+    uint64_t *sorted = malloc(count * sizeof(*sorted) + 1);
+    size_t n = 0;
+    size_t i;
+
+    /* Sorted by first address, overlapping ones merge as they're added */
+    for (i=0; i<count; i++) {
+        if (firsts[i] <= lasts[i])
+            sorted[n++] = (uint64_t)firsts[i] << 32 | lasts[i];
+    }
+    qsort(sorted, n, sizeof(*sorted), compare_ranges);
+    for (i=0; i<n; i++)
+        runs_add(&r, (uint32_t)(sorted[i] >> 32), (uint32_t)sorted[i]);
+    free(sorted);
+
+    add_runs(s, &r);
+    runs_free(&r);
+}
+
+/**
+ * Adds all the addresses in `src` to `dst`. They can be different
+ * kinds.
+ */
+void
+ipset_merge(struct ipset *dst, const struct ipset *src) {
+    struct runs r = {NULL, NULL, 0, 0};
+    size_t i;
+
+    if (dst->kind == IPSET_BITMAP && src->kind == IPSET_BITMAP) {
+        /* Only write words with bits in them, so that where `src`
+         * is empty, `dst`'s pages stay unmapped */
+        for (i=0; i<((size_t)1 << 26); i++) {
+            if (src->bits[i])
+                dst->bits[i] |= src->bits[i];
+        }
+        return;
+    }
+
+    /* Anything else goes through a list of ranges */
+    switch (src->kind) {
+    case IPSET_BITMAP:
+        bitmap_runs(&r, src->bits, (size_t)1 << 32, 0);
+        break;
+    case IPSET_RANGES:
+        for (i=0; i<src->count; i++)
+            runs_add(&r, src->firsts[i], src->lasts[i]);
+        break;
+    case IPSET_ROARING:
+        for (i=0; i<65536; i++) {
+            const struct container *c = src->containers[i];
+            uint32_t k;
+            if (c == NULL)
+                continue;
+            if (c->bitmap)
+                bitmap_runs(&r, c->bitmap, 65536, (uint32_t)i << 16);
+            else {
+                for (k=0; k<c->cardinality; k++) {
+                    uint32_t x = (uint32_t)i << 16 | c->array[k];
+                    runs_add(&r, x, x);
+                }
+            }
+        }
+        break;
+    }
+    add_runs(dst, &r);
+    runs_free(&r);
+}
+
+/**
+ * Looks up a batch of addresses. If `results` isn't NULL, it's set to
+ * 1 for each address in the set and 0 for the rest.
+ * @returns how many were in the set
+ */
+size_t
+ipset_contains(const struct ipset *s, const uint32_t *addresses, size_t count, uint8_t *results) {
+    size_t hits = 0;
+    size_t i;
+
+    switch (s->kind) {
+    case IPSET_BITMAP:
+        for (i=0; i<count; i++) {
+            uint8_t hit = (s->bits[addresses[i] >> 6] >> (addresses[i] & 63)) & 1;
+            if (results)
+                results[i] = hit;
+            hits += hit;
+        }
+        break;
+    case IPSET_RANGES:
+        if (s->count == 0) {
+            if (results)
+                memset(results, 0, count);
+            break;
+        }
+        for (i=0; i<count; i += LOCKSTEP) {
+            size_t n = count - i < LOCKSTEP ? count - i : LOCKSTEP;
+            hits += ranges_lookup(s, addresses + i, n, results ? results + i : NULL);
+        }
+        break;
+    case IPSET_ROARING:
+        for (i=0; i<count; i++) {
+            const struct container *c = s->containers[addresses[i] >> 16];
+            uint8_t hit = c ? (uint8_t)container_contains(c, (uint16_t)addresses[i]) : 0;
+            if (results)
+                results[i] = hit;
+            hits += hit;
+        }
+        break;
+    }
+    return hits;
+}
+
+/**
+ * @returns the bytes the set has allocated, counting the whole bitmap
+ * even where its pages haven't been touched
+ */
+size_t
+ipset_memory(const struct ipset *s) {
+    size_t bytes = sizeof(*s);
+    size_t i;
+
+    switch (s->kind) {
+    case IPSET_BITMAP:
+        bytes += ((size_t)1 << 26) * sizeof(*s->bits);
+        break;
+    case IPSET_RANGES:
+        bytes += s->capacity * (sizeof(*s->firsts) + sizeof(*s->lasts));
+        break;
+    case IPSET_ROARING:
+        bytes += 65536 * sizeof(*s->containers);
+        for (i=0; i<65536; i++) {
+            const struct container *c = s->containers[i];
+            if (c == NULL)
+                continue;
+            bytes += sizeof(*c);
+            bytes += c->bitmap ? 1024 * sizeof(*c->bitmap) : c->capacity * sizeof(*c->array);
+        }
+        break;
+    }
+    return bytes;
+}
@@ -0,0 +1,282 @@
+/*
+    Longest-prefix match of addresses against a routing table
+
+ Once parsed, addresses are often classified against a table of
+ prefixes, such as a BGP table mapping prefixes to the AS that
+ announces them, with about 1M entries. Each address gets the class
+ of the longest prefix that contains it.
+
+ This is DIR-24-8, as in DPDK's `rte_lpm`:
+ - `tbl24` has an entry for each of the 16M /24 blocks, indexed by
+   the top 24 bits of the address. Most prefixes are /24 or shorter,
+   and then the entry is the answer, in one memory access.
+ - An entry for a /24 with longer prefixes in it instead points to a
+   group of 256 entries in `tbl8`, indexed by the last octet, so
+   those take two accesses.
+
+ An entry is a class ID of 1 to 0x7FFFFFFF, or 0 for no match, or,
+ with the top bit set, the number of a `tbl8` group.
+
+ The table is built all at once, from prefixes added before it with
+ `lpm_add_range()`. That takes the `[first, last]` the CIDR parsers
+ return, so a range that isn't a single block is split into the
+ blocks that make it up. The build sorts them by length, shortest
+ first, and writes each over the entries it covers, so longer
+ prefixes overwrite the shorter ones that contain them. All the /24
+ and shorter ones are done before any longer one needs a `tbl8`
+ group, so a new group is simply filled from the `tbl24` entry it
+ replaces.
+
+ `tbl24` is 64 MB, so nearly every lookup is a cache miss. Lookups
+ are done in batches, prefetching the `tbl24` entries of the next
+ batch, and the `tbl8` entries of this one, before they're needed,
+ so the misses overlap instead of each waiting for the last.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    TBL24_SIZE = 1 << 24,
+    GROUP_SIZE = 256,
+    BATCH = 16,
+    CHUNK = 1024,               /* addresses parsed per lookup */
+};
+
+#define IS_GROUP 0x80000000u
+
+struct route {
+    uint32_t prefix;
+    uint32_t class_id;
+    unsigned length;
+};
+
+struct lpm {
+    uint32_t *tbl24;
+    uint32_t *tbl8;
+    size_t groups;
+    size_t group_capacity;
+    struct route *routes;
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * Creates an empty table.
+ * @returns NULL if out of memory
+ */
+struct lpm *
+lpm_create(void) {
+    return calloc(1, sizeof(struct lpm));
+}
+
+void
+lpm_free(struct lpm *t) {
+    if (t == NULL)
+        return;
+    free(t->routes);
+    free(t->tbl8);
+    free(t->tbl24);
+    free(t);
+}
+
+static int
+add_route(struct lpm *t, uint32_t prefix, unsigned length, uint32_t class_id) {
+    if (t->count == t->capacity) {
+        size_t capacity = t->capacity * 2 + 1024;
+        struct route *routes = realloc(t->routes, capacity * sizeof(*routes));
+        if (routes == NULL)
+            return -1;
+        t->routes = routes;
+        t->capacity = capacity;
+    }
+    t->routes[t->count].prefix = prefix;
+    t->routes[t->count].class_id = class_id;
+    t->routes[t->count].length = length;
+    t->count++;
+    return 0;
+}
+
+/**
+ * Adds the addresses `[first, last]` with the class `class_id`, to
+ * take effect at the next `lpm_build()`. A CIDR block is one prefix;
+ * any other range is split into the largest aligned blocks that fit.
+ * When the same prefix is added twice, the last one wins.
+ * @returns 0, or -1 if the range or class isn't valid or out of memory
+ */
+int
+lpm_add_range(struct lpm *t, uint32_t first, uint32_t last, uint32_t class_id) {
+    uint64_t at = first;
+
+    if (first > last || class_id == 0 || (class_id & IS_GROUP))
+        return -1;
+    while (at <= last) {
+        /* The biggest block that starts at `at` and doesn't go past `last` */
+        unsigned bits = at ? (unsigned)__builtin_ctz((uint32_t)at) : 32;
+        while ((at + ((uint64_t)1 << bits)) - 1 > last)
+            bits--;
+        if (add_route(t, (uint32_t)at, 32 - bits, class_id) != 0)
+            return -1;
+        at += (uint64_t)1 << bits;
+    }
+    return 0;
+}
+
+/**
+ * (Re)builds the lookup tables from all the prefixes added so far.
+ * @returns 0, or -1 if out of memory
+ */
+int
+lpm_build(struct lpm *t) {
+    size_t starts[34] = {0};
+    struct route *sorted;
+    size_t i;
+
+    if (t->tbl24 == NULL) {
+        /* 64-MB, an entry per /24. The first build only writes the
+         * /24s that routes cover, so without a default route most of
+         * it is never mapped. */
+        t->tbl24 = calloc(TBL24_SIZE, sizeof(*t->tbl24));
+        if (t->tbl24 == NULL)
+            return -1;
+    } else
+        memset(t->tbl24, 0, TBL24_SIZE * sizeof(*t->tbl24));
+    t->groups = 0;
+
+    /* A stable counting sort by length */
+    sorted = malloc((t->count + 1) * sizeof(*sorted));
+    if (sorted == NULL)
+        return -1;
+    for (i=0; i<t->count; i++)
+        starts[t->routes[i].length + 1]++;
+    for (i=1; i<34; i++)
+        starts[i] += starts[i - 1];
+    for (i=0; i<t->count; i++)
+        sorted[starts[t->routes[i].length]++] = t->routes[i];
+
+    for (i=0; i<t->count; i++) {
+        const struct route *r = &sorted[i];
+        uint32_t *entry;
+        size_t n, k;
+
+        if (r->length <= 24) {
+            entry = t->tbl24 + (r->prefix >> 8);
+            n = (size_t)1 << (24 - r->length);
+        } else {
+            uint32_t *e24 = t->tbl24 + (r->prefix >> 8);
+
+            if (!(*e24 & IS_GROUP)) {
+                if (t->groups == t->group_capacity) {
+                    size_t capacity = t->group_capacity * 2 + 64;
+                    uint32_t *tbl8 = realloc(t->tbl8, capacity * GROUP_SIZE * sizeof(*tbl8));
+                    if (tbl8 == NULL) {
+                        free(sorted);
+                        return -1;
+                    }
+                    t->tbl8 = tbl8;
+                    t->group_capacity = capacity;
+                }
+                for (k=0; k<GROUP_SIZE; k++)
+                    t->tbl8[t->groups * GROUP_SIZE + k] = *e24;
+                *e24 = IS_GROUP | (uint32_t)t->groups++;
+            }
+            entry = t->tbl8 + (size_t)(*e24 & ~IS_GROUP) * GROUP_SIZE + (r->prefix & 0xFF);
+            n = (size_t)1 << (32 - r->length);
+        }
+        for (k=0; k<n; k++)
+            entry[k] = r->class_id;
+    }
+    free(sorted);
+
+    /* Give back what doubling the groups left unused */
+    if (t->groups && t->groups < t->group_capacity) {
+        uint32_t *tbl8 = realloc(t->tbl8, t->groups * GROUP_SIZE * sizeof(*tbl8));
+        if (tbl8) {
+            t->tbl8 = tbl8;
+            t->group_capacity = t->groups;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @returns the bytes the lookup tables take
+ */
+size_t
+lpm_memory(const struct lpm *t) {
+    return (t->tbl24 ? TBL24_SIZE * sizeof(*t->tbl24) : 0)
+         + t->group_capacity * GROUP_SIZE * sizeof(*t->tbl8);
+}
+
+/**
+ * Looks up `count` addresses, writing the class of each to
+ * `classes[]`, or 0 if no prefix matched. `classes` may be the same
+ * array as `addresses`, to classify them in place.
+ * @returns the number that matched
+ */
+size_t
+lpm_lookup(const struct lpm *t, const uint32_t *addresses, size_t count, uint32_t *classes) {
+    const uint32_t *tbl24 = t->tbl24;
+    const uint32_t *tbl8 = t->tbl8;
+    size_t hits = 0;
+    size_t i, k;
+
+    for (i=0; i<count && i<BATCH; i++)
+        __builtin_prefetch(&tbl24[addresses[i] >> 8]);
+
+    for (i=0; i<count; i += BATCH) {
+        size_t n = count - i < BATCH ? count - i : BATCH;
+        uint32_t a[BATCH];
+        uint32_t e[BATCH];
+
+        /* This batch's tbl24 entries, which were prefetched the last
+         * time around, and a prefetch of the tbl8 ones they point to */
+        for (k=0; k<n; k++) {
+            a[k] = addresses[i + k];
+            e[k] = tbl24[a[k] >> 8];
+            if (e[k] & IS_GROUP)
+                __builtin_prefetch(&tbl8[(size_t)(e[k] & ~IS_GROUP) * GROUP_SIZE + (a[k] & 0xFF)]);
+        }
+        for (k=i+BATCH; k<count && k<i+2*BATCH; k++)
+            __builtin_prefetch(&tbl24[addresses[k] >> 8]);
+
+        for (k=0; k<n; k++) {
+            uint32_t c = e[k];
+            if (c & IS_GROUP)
+                c = tbl8[(size_t)(c & ~IS_GROUP) * GROUP_SIZE + (a[k] & 0xFF)];
+            classes[i + k] = c;
+            hits += c != 0;
+        }
+    }
+    return hits;
+}
+
+/**
+ * Parses the addresses in `buf` with `streamer` and looks them up,
+ * writing their classes to `classes[]`, with the same arguments and
+ * result as a streamer. The addresses are parsed a chunk at a time,
+ * and looked up in place while the chunk is still in the L1 cache,
+ * so there's no array of addresses written out and read back.
+ */
+size_t
+lpm_parse_lookup(const struct lpm *t, const char *buf, size_t len,
+                 size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *),
+                 uint32_t *classes, size_t max_out, size_t *consumed) {
+    size_t offset = 0;
+    size_t n = 0;
+
+    while (n < max_out) {
+        size_t used;
+        size_t want = max_out - n < CHUNK ? max_out - n : CHUNK;
+        size_t count = streamer(buf + offset, len - offset, classes + n, want, &used);
+
+        lpm_lookup(t, classes + n, count, classes + n);
+        n += count;
+        offset += used;
+        if (count < want)
+            break;
+    }
+    *consumed = offset;
+    return n;
+}
@@ -5,6 +5,7 @@
  parsing styles in general, and how they work on different compilers,
  CPUs, optimizations, and so forth.
  */
+#define _DEFAULT_SOURCE /* for MAP_ANONYMOUS */
 #include "bench.h"
 #include <stdlib.h>
 #include <string.h>
@@ -15,159 +16,2313 @@
 #include <pthread.h>
 #include <unistd.h>
 #endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+
+/*
+ * These are the prototypes/declarations for the various parser
+ * algorithms held in other files.
+ */
+size_t parse_ip_ai(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_fromchars(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_swar(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_swar2(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_neon(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_sse(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_shape(const char *buf, size_t maxlen, uint32_t *out);
+void parse_ip_shape_init(void);
+size_t parse_ip_batch_avx2(const char *buf, size_t count, uint32_t *out);
+size_t parse_ip_batch_avx512(const char *buf, size_t count, uint32_t *out);
+size_t parse_ip_fsm(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_fsm2(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_fsm_goto(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_fsm_tail(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_dfa(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_dfa_compact(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_dfa_pair(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_dfagen(const char *buf, size_t maxlen, uint32_t *out);
+size_t parse_ip_dfa_batch(const char *buf, size_t count, uint32_t *out);
+void parse_ip_dfa_init(void);
+size_t parse_ip_scan(const char *buf, size_t len, uint32_t *out, size_t max);
+size_t parse_ip_scan_ends(const char *buf, size_t len, uint64_t *ends);
+size_t parse_ip_stream_sse(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_stream_swar(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_stream_scalar(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_stream(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_stream_dfa(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_stream_fsm(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_stream_extract(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+size_t parse_ip_extract(const char *buf, size_t len, uint32_t *out, size_t *offsets, size_t max, size_t *consumed);
+long long parse_ip_fd(int fd, size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *),
+                      void (*sink)(const uint32_t *addresses, size_t count, void *arg), void *arg,
+                      unsigned long long *bytes);
+long long parse_ip_uring(int fd, size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *),
+                         void (*sink)(const uint32_t *addresses, size_t count, void *arg), void *arg,
+                         unsigned long long *bytes);
+int parse_ip_uring_available(void);
+size_t parse_ip_parallel(const char *buf, size_t len, size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *),
+                         unsigned threads, int ordered, uint32_t *out);
+size_t parse_ip_parallel_max(size_t len);
+struct ipfile_writer *ipfile_create(const char *filename, int network_order);
+void ipfile_sink(const uint32_t *addresses, size_t count, void *arg);
+int ipfile_finish(struct ipfile_writer *w);
+uint32_t ipfile_encode(uint32_t *dst, const uint32_t *src, size_t count, int network_order);
+const uint32_t *ipfile_map(const char *filename, uint64_t *count, int *network_order, uint32_t *checksum);
+void ipfile_unmap(const uint32_t *addresses, uint64_t count);
+size_t ip_radix_sort(uint32_t *a, size_t n, uint32_t *tmp, unsigned digit_bits, unsigned threads, int unique);
+struct ipset *ipset_create(int kind);
+void ipset_free(struct ipset *s);
+void ipset_insert(struct ipset *s, const uint32_t *addresses, size_t count);
+void ipset_insert_ranges(struct ipset *s, const uint32_t *firsts, const uint32_t *lasts, size_t count);
+void ipset_merge(struct ipset *dst, const struct ipset *src);
+size_t ipset_contains(const struct ipset *s, const uint32_t *addresses, size_t count, uint8_t *results);
+size_t ipset_memory(const struct ipset *s);
+void parse_ip_scan_init(void);
+size_t parse_ip_index(const char *buf, size_t len, uint32_t *offsets);
+size_t parse_ip_index_parse(const char *buf, size_t len, const uint32_t *offsets, size_t count,
+                            uint32_t *out, size_t (*parse_len)(const char *, size_t, uint32_t *));
+size_t parse_ip_sse_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_ip_swar2_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_ip_scalar_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_cidr_fsm(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last);
+size_t parse_cidr_swar(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last);
+size_t parse_cidr_sse(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last);
+void format_ip_init(void);
+size_t format_ip_table(uint32_t ip, char *out);
+size_t format_ip_swar(uint32_t ip, char *out);
+size_t format_ip_batch_sse(const uint32_t *ips, size_t count, char *out, char separator);
+struct agg *agg_create(int kind, size_t k);
+void agg_free(struct agg *a);
+int agg_add(struct agg *a, const uint32_t *addresses, size_t count);
+void agg_sink(const uint32_t *addresses, size_t count, void *arg);
+size_t agg_parse(struct agg *a, const char *buf, size_t len,
+                 size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *), size_t *consumed);
+uint64_t agg_total(const struct agg *a);
+size_t agg_memory(const struct agg *a);
+size_t agg_top(const struct agg *a, size_t max, uint32_t *keys, uint64_t *counts, uint64_t *errors);
+struct lpm *lpm_create(void);
+void lpm_free(struct lpm *t);
+int lpm_add_range(struct lpm *t, uint32_t first, uint32_t last, uint32_t class_id);
+int lpm_build(struct lpm *t);
+size_t lpm_memory(const struct lpm *t);
+size_t lpm_lookup(const struct lpm *t, const uint32_t *addresses, size_t count, uint32_t *classes);
+size_t lpm_parse_lookup(const struct lpm *t, const char *buf, size_t len,
+                        size_t (*streamer)(const char *, size_t, uint32_t *, size_t, size_t *),
+                        uint32_t *classes, size_t max_out, size_t *consumed);
+
+/**
+ * This is a traditional LCG random number generator. I want
+ * it to return a full 32-bits of randomnous so one call generates
+ * an address (instead of building addresses from multiple calls).
+ * The point is to use a DETERMINISTIC random number generator
+ * so the same seed always produces the same sequence of
+ * numbers. This makes test reproducibility easier.
+ */
+uint32_t lcg32(uint64_t *state) {
+    uint64_t product = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    *state = product;  /* Full 64-bit state for better quality */
+    return product >> 32;
+}
+
+
+
+/*
+ * All the parser functions must conform to this prototype.
+ * @returns
+ *  >0 : number of bytes consumed, not including delimeter
+ *   0 : parse failure
+ */
+typedef size_t (*PARSER)(const char *buf, size_t maxlen, uint32_t *out);
+
+/*
+ * Batch parsers parse `count` addresses at once, laid out on a
+ * 16-byte stride the way `create_test_case()` does it. This lets
+ * SIMD parsers put several addresses in one register.
+ * Invalid addresses are written to `out` as 0.
+ * @returns
+ *  number of valid addresses parsed
+ */
+typedef size_t (*BATCH_PARSER)(const char *buf, size_t count, uint32_t *out);
+
+/*
+ * Scanners find the addresses in a buffer of text by themselves,
+ * without being told where each one starts.
+ * @returns
+ *  number of addresses found, at most `max`
+ */
+typedef size_t (*SCANNER)(const char *buf, size_t len, uint32_t *out, size_t max);
+
+/*
+ * Streamers parse a buffer of whitespace separated addresses, and
+ * report how much of it they used so the rest can be kept for the
+ * next call.
+ * @returns
+ *  number of addresses parsed, at most `max_out`
+ */
+typedef size_t (*STREAMER)(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+
+/*
+ * Range parsers parse an address, a CIDR block (`10.0.0.0/8`), or a
+ * range (`10.0.0.1-10.0.0.99`), into the first and last address
+ * covered.
+ * @returns
+ *  >0 : number of bytes consumed, not including delimeter
+ *   0 : parse failure
+ */
+typedef size_t (*RANGE_PARSER)(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last);
+
+/*
+ * Formatters are the reverse of parsers: they write an address as
+ * text, without a terminator, and may write up to 16 bytes.
+ * @returns
+ *  the length of the text
+ */
+typedef size_t (*FORMATTER)(uint32_t ip, char *out);
+
+/*
+ * Batch formatters write `count` addresses, each followed by
+ * `separator`.
+ * @returns
+ *  the number of bytes written
+ */
+typedef size_t (*BATCH_FORMATTER)(const uint32_t *ips, size_t count, char *out, char separator);
+
+/*
+ * The kinds of `struct agg`, in the order of `enum agg_kind`.
+ */
+enum { AGG_PER24, AGG_ADDRESS, AGG_TOPK };
+
+static int
+compare_addresses(const void *lhs, const void *rhs) {
+    uint32_t a = *(const uint32_t *)lhs;
+    uint32_t b = *(const uint32_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+static int
+compare_ranges(const void *lhs, const void *rhs) {
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Prints one row of the results table. The numbers are per address.
+ */
+static void
+print_result(const char *name, bench_result_t counters, uint64_t iterations, unsigned checksum) {
+    printf("[%6s] %5.1f-GHz %5.1f-ns %4llu %4llu %4.1f %4llu %4.1f %4.1f    [0x%08x]\n", name,
+           counters.cycles/counters.elapsed_seconds/1000000000.0,
+           1000000000.0 * counters.elapsed_seconds/iterations,
+           (unsigned long long)(counters.cycles/iterations),
+           (unsigned long long)(counters.instructions/iterations),
+           1.0 * counters.instructions/counters.cycles,
+           (unsigned long long)(counters.branches/iterations),
+           1.0 * counters.branch_misses/iterations,
+           1.0 * counters.l1d_misses/iterations,
+           checksum
+           );
+}
+
+/**
+ * This function benchmarks a single parser algorithm. It's called multiple
+ *  times, for different algorithms, and different sized test buffers.
+ */
+static void
+run_benchmark(const char *test, size_t N, size_t C, const char *name, PARSER parser, unsigned in_sum) {
+    unsigned checksum;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    
+    /*
+     * This variable does two things. First, it'll act as a
+     * 'sink' to prevent optimizers removing code that
+     * doens't contribute to a result. Second, it verifies
+     * that the parsers are working correctly: if there
+     * is a subtle bug in parsing addresses, this will
+     * detect it.
+     */
+    checksum = 0;
+    
+    /*
+     * Run the benchmarked code `C` times.
+     * Each run parses `N` addresses.
+     */
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        for (i=0; i<N; i++) {
+            unsigned ip_address;
+            parser(test + i*16, 16, &ip_address);
+            checksum += ip_address;
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+}
+
+#ifndef FASTAI
+/**
+ * Same as `run_benchmark()`, but for parsers that do a whole batch of
+ * addresses in one call. Results are still reported per address.
+ */
+static void
+run_benchmark_batch(const char *test, size_t N, size_t C, const char *name, BATCH_PARSER parser, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    uint32_t *out = malloc(N * sizeof(*out));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        parser(test, N, out);
+        for (i=0; i<N; i++)
+            checksum += out[i];
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(out);
+}
+
+/**
+ * Same as `run_benchmark()`, but for scanners, which are given all
+ * `N` addresses as one block of text.
+ */
+static void
+run_benchmark_scan(const char *test, size_t N, size_t C, const char *name, SCANNER scanner, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    uint32_t *out = malloc(N * sizeof(*out));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t count = scanner(test, N * 16, out, N);
+        for (i=0; i<count; i++)
+            checksum += out[i];
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(out);
+}
+
+/**
+ * Times just the DFA pass of the scanner, which marks where the
+ * candidates end without checking them. The checksum is how far the
+ * number of candidates is from `N`.
+ */
+static void
+run_benchmark_scan_ends(const char *test, size_t N, size_t C, const char *name) {
+    unsigned checksum = 0;
+    size_t repeat;
+    const uint64_t iterations = N * C;
+    uint64_t *ends = malloc((N * 16 / 64 + 1) * sizeof(*ends));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t count = parse_ip_scan_ends(test, N * 16, ends);
+        checksum += (unsigned)(count - N);
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum);
+    free(ends);
+}
+
+/**
+ * Same as `run_benchmark()`, but for streamers. The text is handed
+ * over 64-KB at a time, the way it'd come from `read()`, with any
+ * address cut off at the end of a block carried over to the next.
+ */
+static void
+run_benchmark_stream(const char *text, size_t length, size_t N, size_t C, const char *name, STREAMER streamer, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    uint32_t *out = malloc(N * sizeof(*out));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t offset = 0;
+        while (offset < length) {
+            size_t block = length - offset < 65536 ? length - offset : 65536;
+            size_t consumed;
+            size_t count = streamer(text + offset, block, out, N, &consumed);
+            for (i=0; i<count; i++)
+                checksum += out[i];
+            if (consumed == 0)
+                break;
+            offset += consumed;
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(out);
+}
+
+/**
+ * Times finding the addresses in log text with `parse_ip_extract()`,
+ * the whole text at once.
+ */
+static void
+run_benchmark_extract(const char *text, size_t length, size_t N, size_t C, const char *name, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    uint32_t *out = malloc(N * sizeof(*out));
+    size_t *offsets = malloc(N * sizeof(*offsets));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t consumed;
+        size_t count = parse_ip_extract(text, length, out, offsets, N, &consumed);
+        for (i=0; i<count; i++)
+            checksum += out[i];
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(offsets);
+    free(out);
+}
+
+/**
+ * Same as `run_benchmark()`, but for range parsers, on the 32-byte
+ * stride of `create_cidr_case()`. Each is given the rest of the
+ * buffer, as it would be in a file, rather than just its 32 bytes.
+ */
+static void
+run_benchmark_cidr(const char *test, size_t N, size_t C, const char *name, RANGE_PARSER parser, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        for (i=0; i<N; i++) {
+            uint32_t first, last;
+            parser(test + i*32, (N - i) * 32, &first, &last);
+            checksum += first + last;
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+}
+
+/**
+ * Times the longest-prefix-match table in `src/lpm.c`, all in one
+ * go, since the lookups need the table:
+ * - building it from `nroutes` CIDR blocks as text, parsed with
+ *   `parse_cidr_swar()`, per block;
+ * - lookups of the random addresses, `N` of them `C*100` times, and
+ *   `N*100` of them `C` times;
+ * - the same `N*100` addresses parsed from text and looked up as
+ *   they're parsed, with `lpm_parse_lookup()`.
+ * The checksums are of the classes found.
+ */
+static void
+run_benchmark_lpm(const char *routes, size_t nroutes, const char *text, size_t length, size_t N, size_t C,
+                  unsigned in_sum, unsigned in_sum_big) {
+    struct lpm *t = lpm_create();
+    uint32_t *addresses = malloc(N * 100 * sizeof(*addresses));
+    uint32_t *classes = malloc(N * 100 * sizeof(*classes));
+    uint64_t seed = 1;
+    unsigned checksum = 0;
+    size_t added = 0;
+    size_t repeat;
+    size_t i;
+
+    for (i=0; i<N*100; i++)
+        addresses[i] = lcg32(&seed);
+
+    bench_ctx *ctx = bench_start();
+    for (i=0; i<nroutes; i++) {
+        uint32_t first, last;
+        if (parse_cidr_swar(routes + i*32, (nroutes - i) * 32, &first, &last)
+            && lpm_add_range(t, first, last, (uint32_t)(i % 65535) + 1) == 0)
+            added++;
+    }
+    if (lpm_build(t) != 0) {
+        fprintf(stderr, "[-] lpm: out of memory\n");
+        bench_stop(ctx);
+        lpm_free(t);
+        free(classes);
+        free(addresses);
+        return;
+    }
+    bench_result_t counters = bench_stop(ctx);
+    print_result(" lpmb+", counters, nroutes, (unsigned)(nroutes - added));
+    printf("%8s %llu prefixes, built in %.3f seconds, %.1f MB\n", "",
+           (unsigned long long)nroutes, counters.elapsed_seconds, lpm_memory(t) / 1000000.0);
+
+    ctx = bench_start();
+    for (repeat=0; repeat<C*100; repeat++) {
+        lpm_lookup(t, addresses, N, classes);
+        for (i=0; i<N; i++)
+            checksum += classes[i];
+    }
+    counters = bench_stop(ctx);
+    print_result(" lpm  ", counters, N * C * 100, checksum - in_sum);
+
+    checksum = 0;
+    ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        lpm_lookup(t, addresses, N*100, classes);
+        for (i=0; i<N*100; i++)
+            checksum += classes[i];
+    }
+    counters = bench_stop(ctx);
+    print_result(" lpm+ ", counters, N * 100 * C, checksum - in_sum_big);
+
+    checksum = 0;
+    ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t consumed;
+        size_t count = lpm_parse_lookup(t, text, length, parse_ip_stream, classes, N*100, &consumed);
+        for (i=0; i<count; i++)
+            checksum += classes[i];
+    }
+    counters = bench_stop(ctx);
+    print_result(" lpmp+", counters, N * 100 * C, checksum - in_sum_big);
+
+    lpm_free(t);
+    free(classes);
+    free(addresses);
+}
+
+/**
+ * Times counting the addresses in `text`, with a `struct agg` of the
+ * given kind, over `C` passes. If `fused`, they're counted a chunk at
+ * a time as they're parsed; otherwise they're all parsed into an
+ * array first, and then counted. The checksum is the sum of each
+ * key times its count, which for `AGG_ADDRESS` is the sum of the
+ * addresses, like the other rows. For `AGG_TOPK`, it's how far the
+ * counts add up from the number of addresses.
+ */
+static void
+run_benchmark_agg(const char *text, size_t length, size_t N, size_t C, const char *name,
+                  int kind, int fused, unsigned in_sum) {
+    struct agg *a = agg_create(kind, 1000);
+    uint32_t *addresses = malloc(N * sizeof(*addresses));
+    uint64_t *counts = malloc(N * sizeof(*counts));
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t found;
+    size_t i;
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t consumed;
+        if (fused)
+            agg_parse(a, text, length, parse_ip_stream, &consumed);
+        else
+            agg_add(a, addresses, parse_ip_stream(text, length, addresses, N, &consumed));
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    found = agg_top(a, N, addresses, counts, NULL);
+    for (i=0; i<found; i++)
+        checksum += kind == AGG_TOPK ? (unsigned)counts[i] : addresses[i] * (unsigned)counts[i];
+    if (kind == AGG_TOPK)
+        checksum -= (unsigned)agg_total(a);
+    print_result(name, counters, N * C, checksum - in_sum);
+    agg_free(a);
+    free(counts);
+    free(addresses);
+}
+
+/**
+ * `snprintf()` as a formatter, the way the output path did it, to
+ * compare the others with.
+ */
+static size_t
+format_ip_snprintf(uint32_t ip, char *out) {
+    return (size_t)snprintf(out, 16, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+}
+
+/**
+ * Times formatting `N` random addresses, one per line, `C` times,
+ * with either `formatter` or `batch`. The checksum is a round trip:
+ * the text is parsed back, and the sum of the addresses is counted
+ * `C` times, like the parsers' checksums.
+ */
+static void
+run_benchmark_format(size_t N, size_t C, const char *name, FORMATTER formatter, BATCH_FORMATTER batch, unsigned in_sum) {
+    uint32_t *addresses = malloc(N * sizeof(*addresses));
+    char *text = malloc(N * 16 + 16);
+    uint64_t seed = 1;
+    unsigned checksum = 0;
+    size_t length = 0;
+    size_t consumed;
+    size_t repeat;
+    size_t count;
+    size_t i;
+
+    for (i=0; i<N; i++)
+        addresses[i] = lcg32(&seed);
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        if (batch)
+            length = batch(addresses, N, text, '\n');
+        else {
+            length = 0;
+            for (i=0; i<N; i++) {
+                length += formatter(addresses[i], text + length);
+                text[length++] = '\n';
+            }
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    count = parse_ip_stream(text, length, addresses, N, &consumed);
+    for (i=0; i<count; i++)
+        checksum += addresses[i];
+    print_result(name, counters, N * C, checksum * (unsigned)C - in_sum + (unsigned)(N - count));
+    free(text);
+    free(addresses);
+}
+
+/**
+ * Times stage 1 of the two-stage parser, finding the tokens in the
+ * whole text. There are no addresses yet, so the checksum is how
+ * far the number of tokens found is from `N`.
+ */
+static void
+run_benchmark_index(const char *text, size_t length, size_t N, size_t C, const char *name) {
+    unsigned checksum = 0;
+    size_t repeat;
+    const uint64_t iterations = N * C;
+    uint32_t *offsets = malloc((length + 1) * sizeof(*offsets));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t count = parse_ip_index(text, length, offsets);
+        checksum += (unsigned)(count / 2 - N);
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum);
+    free(offsets);
+}
+
+/**
+ * Times stage 2 of the two-stage parser on its own: the text is
+ * indexed once up front, then only the parsing of the tokens with
+ * `parse_len` is timed.
+ */
+static void
+run_benchmark_index_parse(const char *text, size_t length, size_t N, size_t C, const char *name, PARSER parse_len, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    uint32_t *offsets = malloc((length + 1) * sizeof(*offsets));
+    uint32_t *out = malloc(N * sizeof(*out));
+    size_t count = parse_ip_index(text, length, offsets);
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t n = parse_ip_index_parse(text, length, offsets, count, out, parse_len);
+        for (i=0; i<n; i++)
+            checksum += out[i];
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(out);
+    free(offsets);
+}
+
+/**
+ * A test case for the parsers that take the exact length of an
+ * address: each address is in a 16-byte slot, with the rest of the
+ * slot filled with digits, so a parser that looks at the byte past
+ * `length` sees what looks like more of the last octet. The lengths
+ * go in `lengths[]`.
+ */
+static char *
+create_tight_case(unsigned char *lengths, size_t N, uint64_t seed) {
+    char *slots = malloc(N * 16 + 16);
+    size_t i, k;
+
+    for (i=0; i<N; i++) {
+        unsigned ip_address = lcg32(&seed);
+        char *slot = slots + i * 16;
+
+        lengths[i] = (unsigned char)format_ip_table(ip_address, slot);
+        for (k=lengths[i]; k<16; k++)
+            slot[k] = (char)('0' + (i + k) % 10);
+    }
+    memset(slots + N * 16, '0', 16);
+    return slots;
+}
+
+/**
+ * Same as `run_benchmark()`, but for a `parse_len` parser given the
+ * exact length of each address in a case from `create_tight_case()`.
+ */
+static void
+run_benchmark_tight(const char *slots, const unsigned char *lengths, size_t N, size_t C,
+                    const char *name, PARSER parse_len, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        for (i=0; i<N; i++) {
+            unsigned ip_address = 0;
+            parse_len(slots + i * 16, lengths[i], &ip_address);
+            checksum += ip_address;
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+}
+
+/**
+ * Times converting text to the packed binary format: the same as
+ * `run_benchmark_stream()` with `parse_ip_stream()`, but each block of
+ * addresses is also stored in the file's byte order, as
+ * `ipfile_sink()` does before writing it.
+ */
+static void
+run_benchmark_pack(const char *text, size_t length, size_t N, size_t C, const char *name, int network_order, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    const uint64_t iterations = N * C;
+    uint32_t *out = malloc(N * sizeof(*out));
+    uint32_t *packed = malloc(N * sizeof(*packed));
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t offset = 0;
+        size_t total = 0;
+        while (offset < length) {
+            size_t block = length - offset < 65536 ? length - offset : 65536;
+            size_t consumed;
+            size_t count = parse_ip_stream(text + offset, block, out, N - total, &consumed);
+            checksum += ipfile_encode(packed + total, out, count, network_order);
+            total += count;
+            if (consumed == 0 || total == N)
+                break;
+            offset += consumed;
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(packed);
+    free(out);
+}
+
+/**
+ * Times reading back the packed addresses, which is all a later job
+ * has to do instead of parsing the text again.
+ */
+static void
+run_benchmark_packed(const char *text, size_t length, size_t N, size_t C, const char *name, int network_order, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+    uint32_t *out = malloc(N * sizeof(*out));
+    uint32_t *packed = malloc(N * sizeof(*packed));
+    size_t offset = 0;
+    size_t total = 0;
+
+    while (offset < length) {
+        size_t consumed;
+        total += parse_ip_stream(text + offset, length - offset, out + total, N - total, &consumed);
+        if (consumed == 0)
+            break;
+        offset += consumed;
+    }
+    ipfile_encode(packed, out, total, network_order);
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        if (network_order) {
+            for (i=0; i<total; i++)
+                checksum += __builtin_bswap32(packed[i]);
+        } else {
+            for (i=0; i<total; i++)
+                checksum += packed[i];
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+    free(packed);
+    free(out);
+}
+
+/**
+ * Sorts with `qsort()`, then removes duplicates if `unique` is set,
+ * to compare `ip_radix_sort()` with.
+ */
+static size_t
+qsort_unique(uint32_t *a, size_t n, int unique) {
+    size_t count = 0;
+    size_t i;
+
+    qsort(a, n, sizeof(*a), compare_addresses);
+    if (!unique)
+        return n;
+    for (i=0; i<n; i++) {
+        if (count == 0 || a[count - 1] != a[i])
+            a[count++] = a[i];
+    }
+    return count;
+}
+
+/**
+ * Times sorting the same random addresses that `create_test_case()`
+ * makes, with `ip_radix_sort()`, or with `qsort()` if `digit_bits` is
+ * 0, removing duplicates if `unique` is set. Each run starts from a
+ * fresh copy of the unsorted addresses. The checksum is how far the
+ * result is from what `qsort()` gives, plus any out of order.
+ */
+static void
+run_benchmark_sort(size_t N, size_t C, const char *name, unsigned digit_bits, unsigned threads, int unique) {
+    uint32_t *addresses = malloc(N * sizeof(*addresses));
+    uint32_t *a = malloc(N * sizeof(*a));
+    uint32_t *tmp = malloc(N * sizeof(*tmp));
+    const uint64_t iterations = N * C;
+    uint64_t seed = 1;
+    unsigned checksum = 0;
+    unsigned in_sum = 0;
+    size_t expected;
+    size_t repeat;
+    size_t i;
+
+    for (i=0; i<N; i++)
+        addresses[i] = lcg32(&seed);
+    memcpy(a, addresses, N * sizeof(*a));
+    expected = qsort_unique(a, N, unique);
+    for (i=0; i<expected; i++)
+        in_sum += a[i];
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        size_t count;
+        memcpy(a, addresses, N * sizeof(*a));
+        if (digit_bits)
+            count = ip_radix_sort(a, N, tmp, digit_bits, threads, unique);
+        else
+            count = qsort_unique(a, N, unique);
+        for (i=0; i<count; i++)
+            checksum += a[i] + (i && (unique ? a[i - 1] >= a[i] : a[i - 1] > a[i]));
+        checksum += (unsigned)(count - expected) - in_sum;
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum);
+    free(tmp);
+    free(a);
+    free(addresses);
+}
+
+#if HAVE_MMAP
+/**
+ * A test case where every address has a page to itself, followed by
+ * an unmapped guard page. The address is written both at the very
+ * end of its page, where reading a byte past it crashes, and at the
+ * start, where over-reading is harmless. The rest of the page is
+ * zeroes, which end the address at the start.
+ */
+struct guard_case {
+    char *pages;
+    size_t page_size;
+    unsigned char *lengths;
+};
+
+static struct guard_case
+create_guard_case(size_t N, uint64_t seed) {
+    struct guard_case g;
+    size_t i;
+
+    g.page_size = (size_t)sysconf(_SC_PAGESIZE);
+    g.pages = mmap(NULL, 2 * N * g.page_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (g.pages == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    g.lengths = malloc(N);
+
+    for (i=0; i<N; i++) {
+        unsigned ip_address = lcg32(&seed);
+        char *page = g.pages + 2 * i * g.page_size;
+        char buf[16];
+        size_t length = format_ip_table(ip_address, buf);
+
+        memcpy(page, buf, length);
+        memcpy(page + g.page_size - length, buf, length);
+        g.lengths[i] = (unsigned char)length;
+        mprotect(page + g.page_size, g.page_size, PROT_NONE);
+    }
+    return g;
+}
+
+/*
+ * Where `run_benchmark_guard()` puts each address.
+ */
+enum guard_place {
+    GUARD_START,    /* at the start of its page, with just its bytes */
+    GUARD_END,      /* against the guard page, with just its bytes */
+    GUARD_PAGE,     /* at the start, with the rest of the page after it */
+};
+
+/**
+ * Same as `run_benchmark()`, but on the pages of `create_guard_case()`.
+ * With GUARD_START and GUARD_END each parser is given exactly the
+ * bytes of the address, with the end of the buffer as the only
+ * terminator. GUARD_PAGE is the control: the same pages, but with
+ * the bytes up to the guard page, so the parser takes its usual
+ * 16-byte load.
+ */
+static void
+run_benchmark_guard(const struct guard_case *g, size_t N, size_t C, enum guard_place place,
+                    const char *name, PARSER parser, unsigned in_sum) {
+    unsigned checksum = 0;
+    size_t repeat;
+    size_t i;
+    const uint64_t iterations = N * C;
+
+    bench_ctx *ctx = bench_start();
+    for (repeat=0; repeat<C; repeat++) {
+        for (i=0; i<N; i++) {
+            const char *page = g->pages + 2 * i * g->page_size;
+            size_t length = g->lengths[i];
+            unsigned ip_address;
+            if (place == GUARD_END)
+                parser(page + g->page_size - length, length, &ip_address);
+            else
+                parser(page, place == GUARD_PAGE ? g->page_size : length, &ip_address);
+            checksum += ip_address;
+        }
+    }
+#if defined(__APPLE__)
+    usleep(100);
+#endif
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, iterations, checksum - in_sum);
+}
+#endif
+#endif
+
+/**
+ * Creates a test-case buffer printing random IPv4 addresses into a
+ * buffer separated by one or more spaces.
+ *
+ * Kludge: we are padding every address to 16-bytes, so they
+ * are located at 16-byte boundaries.
+ */
+static char *
+create_test_case(size_t *length, size_t N, uint64_t seed) {
+    size_t i;
+    size_t offset = *length;
+    char* test = malloc(1);
+    *test = '\0';
+
+    /*
+     * Create `N` addresses
+     */
+    for (i=0; i<N; i++) {
+        unsigned ip_address;
+        char buf[64];
+        size_t ip_length;
+     
+        /* Generate a random IPv4 address, 32-bits in size */
+        ip_address = lcg32(&seed);
+        
+        /* Print to a temporary string, padded with spaces to 16 bytes */
+        ip_length = format_ip_table(ip_address, buf);
+        memset(buf + ip_length, ' ', 16 - ip_length);
+        buf[16] = '\0';
+        
+        ip_length = 16;
+        
+        /* Make sure we have enough memory, otherwise, expand
+         * the buffer */
+        while (offset + ip_length + 1 >= *length) {
+            *length = *length * 2 + 1;
+            test = realloc(test, *length);
+        }
+        
+        /* Append */
+        memcpy(test + offset, buf, ip_length+1);
+
+        offset += ip_length;
+    }
+
+    *length = offset;
+    return test;
+}
+
+
+#ifndef FASTAI
+/**
+ * Creates a test-case like `create_test_case()`, with the same
+ * addresses, but not padded: they are separated by runs of 1 to 4
+ * spaces, tabs, and newlines, like text that a program would
+ * actually read.
+ */
+static char *
+create_stream_case(size_t *length, size_t N, uint64_t seed) {
+    uint64_t sep_seed = ~seed;
+    size_t offset = 0;
+    size_t i;
+    char *test = malloc(N * 20 + 1);
+
+    for (i=0; i<N; i++) {
+        unsigned ip_address = lcg32(&seed);
+        unsigned seps = lcg32(&sep_seed);
+        unsigned k;
+
+        offset += format_ip_table(ip_address, test + offset);
+        for (k=0; k<=(seps&3); k++)
+            test[offset++] = " \t\n "[(seps >> (8 + 2*k)) & 3];
+    }
+    test[offset] = '\0';
+
+    *length = offset;
+    return test;
+}
+
+/**
+ * Creates log text with the same addresses as `create_test_case()`,
+ * one per line, among things that look like addresses but aren't:
+ * timestamps, versions, `v10.0.0.1`, `1.2.3.4.5`, and so on. Only the
+ * real addresses should be found, including one before an ellipsis.
+ */
+static char *
+create_log_case(size_t *length, size_t N, uint64_t seed) {
+    static const char *const formats[] = {
+        "2026-01-02T10:11:12.345 host sshd: Failed password for root from %u.%u.%u.%u. Port %u ssh2\n",
+        "%u.%u.%u.%u - - [02/Jan/2026:10:11:12 +0000] \"GET /v10.0.0.1/a.b HTTP/1.1\" 200 %u \"Chrome/120.0.6099.109\"\n",
+        "kernel: [123.456] DROP IN=eth0 SRC=%u.%u.%u.%u DST=v10.0.0.1 LEN=%u TTL=64 ver 1.2.3.4.5\n",
+        "app: client=[%u.%u.%u.%u]:%u id=10.0.0.1a build=2.0.10.300 ok.\n",
+        "proxy: Connecting to %u.%u.%u.%u... timed out after %u ms (ver 3.2.1.0.9..)\n",
+    };
+    uint64_t line_seed = ~seed;
+    size_t offset = 0;
+    size_t i;
+    char *test = malloc(N * 160 + 1);
+
+    for (i=0; i<N; i++) {
+        unsigned ip_address = lcg32(&seed);
+        unsigned r = lcg32(&line_seed);
+
+        offset += (size_t)sprintf(test + offset, formats[r % 5],
+                 (ip_address>>24)&0xFF,
+                 (ip_address>>16)&0xFF,
+                 (ip_address>> 8)&0xFF,
+                 (ip_address>> 0)&0xFF,
+                 (r >> 8) & 0xFFFF);
+    }
+    test[offset] = '\0';
+
+    *length = offset;
+    return test;
+}
+
+/**
+ * A copy of `logs` for `ingest.c`, which reads 4-MB at a time, with a
+ * word too long to carry over cut by the end of the first chunk, and
+ * an address right after it, joined by a byte that's neither a
+ * separator nor part of a word. It has 9.9.9.9 more in its checksum.
+ */
+static char *
+create_straddle_case(size_t *length, const char *logs, size_t logs_length) {
+    static const char after[] = "=9.9.9.9\n";
+    const size_t chunk = 4 * 1024 * 1024;
+    size_t head = chunk - 100;
+    size_t word;
+    char *test = malloc(logs_length + 128 + 1);
+
+    while (head > 0 && logs[head - 1] != '\n')
+        head--;
+    word = chunk + 30 - head;
+    memcpy(test, logs, head);
+    memset(test + head, 'x', word);
+    memcpy(test + head + word, after, sizeof(after) - 1);
+    memcpy(test + head + word + sizeof(after) - 1, logs + head, logs_length - head);
+    *length = logs_length + word + sizeof(after) - 1;
+    test[*length] = '\0';
+    return test;
+}
+
+/**
+ * Appends `/prefix` to an address being printed.
+ * @returns the new length
+ */
+static size_t
+put_prefix(char *buf, size_t n, unsigned prefix) {
+    buf[n++] = '/';
+    if (prefix >= 10)
+        buf[n++] = (char)('0' + prefix / 10);
+    buf[n++] = (char)('0' + prefix % 10);
+    return n;
+}
+
+/**
+ * Creates a test-case of target-list entries, with the same addresses
+ * as `create_test_case()`, each padded to 32 bytes. A random mix of
+ * syntaxes, so which one comes next can't be predicted: plain
+ * addresses, CIDR blocks of /8 to /32, and ranges of up to 64K
+ * addresses.
+ */
+static char *
+create_cidr_case(size_t N, uint64_t seed) {
+    uint64_t kind_seed = ~seed;
+    char *test = malloc(N * 32 + 1);
+    size_t i;
+
+    for (i=0; i<N; i++) {
+        unsigned ip_address = lcg32(&seed);
+        unsigned r = lcg32(&kind_seed);
+        unsigned end = ip_address + ((r >> 8) & 0xFFFF);
+        char buf[64];
+        size_t n;
+
+        if (end < ip_address)
+            end = 0xFFFFFFFF;
+        n = format_ip_table(ip_address, buf);
+        if ((r & 3) == 1 || (r & 3) == 3)
+            n = put_prefix(buf, n, 8 + (r >> 8) % 25);
+        else if ((r & 3) == 2) {
+            buf[n++] = '-';
+            n += format_ip_table(end, buf + n);
+        }
+        memset(buf + n, ' ', 32 - n);
+        memcpy(test + i*32, buf, 32);
+    }
+    test[N * 32] = '\0';
+    return test;
+}
+
+/**
+ * Creates a routing table of `N` random CIDR blocks, padded to 32
+ * bytes like `create_cidr_case()`, with a mix of lengths roughly like
+ * a BGP table's: mostly /24, then /16 to /23, and a few shorter and
+ * longer.
+ */
+static char *
+create_route_case(size_t N, uint64_t seed) {
+    uint64_t length_seed = ~seed;
+    char *test = malloc(N * 32 + 1);
+    size_t i;
+
+    for (i=0; i<N; i++) {
+        unsigned ip_address = lcg32(&seed);
+        unsigned r = lcg32(&length_seed);
+        unsigned percent = r % 100;
+        unsigned prefix;
+        char buf[64];
+        size_t n;
+
+        if (percent < 60)
+            prefix = 24;
+        else if (percent < 97)
+            prefix = 16 + (r >> 8) % 8;
+        else if (percent < 99)
+            prefix = 8 + (r >> 8) % 8;
+        else
+            prefix = 25 + (r >> 8) % 8;
+        ip_address &= (unsigned)(~0ULL << (32 - prefix));
+        n = put_prefix(buf, format_ip_table(ip_address, buf), prefix);
+        memset(buf + n, ' ', 32 - n);
+        memcpy(test + i*32, buf, 32);
+    }
+    test[N * 32] = '\0';
+    return test;
+}
+#endif
+
+#if HAVE_MMAP
+/*
+ * The parsers that `--file` can use. They all take whitespace
+ * separated text, so work on a file as it is.
+ */
+static const struct {
+    const char *name;
+    STREAMER streamer;
+} file_parsers[] = {
+    {"stream", parse_ip_stream},
+    {"scalar", parse_ip_stream_scalar},
+    {"swar", parse_ip_stream_swar},
+    {"sse", parse_ip_stream_sse},
+    {"dfa", parse_ip_stream_dfa},
+    {"fsm", parse_ip_stream_fsm},
+    {"extract", parse_ip_stream_extract},
+};
+
+/**
+ * Prints the results of `--file` or `--stdin`: the usual row of
+ * counters per address, then the totals and the speed.
+ */
+static void
+print_file_result(const char *name, bench_result_t counters, uint64_t count,
+                  uint64_t length, unsigned checksum) {
+    print_result(name, counters, count ? count : 1, checksum);
+    printf("%8s %llu addresses, %llu bytes, %.3f seconds, %.2f GB/s, %.1f M addresses/s\n", "",
+           (unsigned long long)count, (unsigned long long)length,
+           counters.elapsed_seconds,
+           length / counters.elapsed_seconds / 1000000000.0,
+           count / counters.elapsed_seconds / 1000000.0);
+}
+
+static void
+print_file_header(const char *title) {
+    printf("==[%s]============\n", title);
+    printf("[%6s] %5s     %5s    %4s %4s %4s %4s %4s %4s    %10s\n", "",
+           "freq", "time", "cycl", "inst", "ipc", "brch", "miss", "l1d", "checksum");
+}
+
+static void
+sum_addresses(const uint32_t *addresses, size_t count, void *arg) {
+    unsigned *checksum = arg;
+    size_t i;
+
+    for (i=0; i<count; i++)
+        *checksum += addresses[i];
+}
+
+/**
+ * Parses a whole file that's mapped into memory.
+ * @returns the number of addresses
+ */
+static uint64_t
+parse_mapped(const char *map, size_t length, STREAMER streamer, uint32_t *out, size_t max_out, unsigned *checksum) {
+    uint64_t count = 0;
+    size_t offset = 0;
+
+    while (offset < length) {
+        size_t consumed;
+        size_t n = streamer(map + offset, length - offset, out, max_out, &consumed);
+
+        sum_addresses(out, n, checksum);
+        count += n;
+        if (consumed == 0)
+            break;
+        offset += consumed;
+    }
+
+    /* The last address in the file needs a separator after it */
+    if (offset < length && length - offset < 32) {
+        char tail[33];
+        size_t consumed;
+        size_t n;
+
+        memcpy(tail, map + offset, length - offset);
+        tail[length - offset] = '\n';
+        n = streamer(tail, length - offset + 1, out, max_out, &consumed);
+        sum_addresses(out, n, checksum);
+        count += n;
+    }
+    return count;
+}
+
+/**
+ * Maps all the files, for reading. They aren't read yet, unless
+ * `populate` faults in each whole mapping.
+ * @returns 0 on success, 1 on error, having unmapped any already done
+ */
+static int
+map_files(char **filenames, size_t nfiles, int populate, int sequential,
+          char **maps, size_t *lengths, uint64_t *total) {
+    int flags = MAP_PRIVATE;
+    size_t i;
+
+#if defined(MAP_POPULATE)
+    if (populate)
+        flags |= MAP_POPULATE;
+#else
+    (void)populate;
+#endif
+    *total = 0;
+    for (i=0; i<nfiles; i++) {
+        struct stat st;
+        int fd = open(filenames[i], O_RDONLY);
+
+        maps[i] = NULL;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            perror(filenames[i]);
+            if (fd >= 0)
+                close(fd);
+            goto fail;
+        }
+        lengths[i] = (size_t)st.st_size;
+        if (lengths[i]) {
+            maps[i] = mmap(NULL, lengths[i], PROT_READ, flags, fd, 0);
+            if (maps[i] == MAP_FAILED) {
+                perror(filenames[i]);
+                maps[i] = NULL;
+                close(fd);
+                goto fail;
+            }
+            if (sequential)
+                madvise(maps[i], lengths[i], MADV_SEQUENTIAL);
+        }
+        close(fd);
+        *total += lengths[i];
+    }
+    return 0;
+
+fail:
+    while (i-- > 0) {
+        if (maps[i])
+            munmap(maps[i], lengths[i]);
+    }
+    return 1;
+}
+
+static void
+unmap_files(char **maps, size_t *lengths, size_t nfiles) {
+    size_t i;
+
+    for (i=0; i<nfiles; i++) {
+        if (maps[i])
+            munmap(maps[i], lengths[i]);
+    }
+}
+
+/**
+ * Parses the files in place, through `mmap()`. They're all mapped
+ * before the timing starts, but not read, so this times reading them
+ * from the disk or page cache too, unless `populate` faults in the
+ * whole mapping first.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_files_mmap(char **filenames, size_t nfiles, STREAMER streamer, int populate, int sequential) {
+    enum { OUT_MAX = 65536 };
+    char **maps = calloc(nfiles, sizeof(*maps));
+    size_t *lengths = calloc(nfiles, sizeof(*lengths));
+    unsigned checksum = 0;
+    uint64_t count = 0;
+    uint64_t total;
+    uint32_t *out;
+    size_t i;
+
+    if (map_files(filenames, nfiles, populate, sequential, maps, lengths, &total) != 0) {
+        free(lengths);
+        free(maps);
+        return 1;
+    }
+    out = malloc(OUT_MAX * sizeof(*out));
+
+    bench_ctx *ctx = bench_start();
+    for (i=0; i<nfiles; i++)
+        count += parse_mapped(maps[i], lengths[i], streamer, out, OUT_MAX, &checksum);
+    bench_result_t counters = bench_stop(ctx);
+
+    print_file_result(" mmap ", counters, count, total, checksum);
+
+    unmap_files(maps, lengths, nfiles);
+    free(out);
+    free(lengths);
+    free(maps);
+    return 0;
+}
+
+/**
+ * Not a parser: reads every byte and finds no addresses. Run on the
+ * same threads as a parser, it shows how fast memory can be read at
+ * all, which is as fast as any parser can go.
+ */
+static size_t
+touch_streamer(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed) {
+    static volatile uint64_t sink;
+    uint64_t sum = 0;
+    size_t i;
+
+    (void)out; (void)max_out;
+    for (i=0; i+8<=len; i += 8) {
+        uint64_t word;
+        memcpy(&word, buf + i, sizeof(word));
+        sum += word;
+    }
+    for (; i<len; i++)
+        sum += (unsigned char)buf[i];
+    sink += sum;
+    *consumed = len;
+    return 0;
+}
+
+/**
+ * Parses the mapped files with `parse_ip_parallel()`, on 1, 2, 4, ...
+ * up to `max_threads` threads, to show how it scales. Each thread
+ * count is run a second time with `touch_streamer()`, to show where
+ * memory bandwidth stops it scaling any further. Use `--populate`, or
+ * the first row also times reading the files in.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_files_parallel(char **filenames, size_t nfiles, STREAMER streamer, int populate, int sequential,
+                   unsigned max_threads, int ordered) {
+    char **maps = calloc(nfiles, sizeof(*maps));
+    size_t *lengths = calloc(nfiles, sizeof(*lengths));
+    size_t longest = 0;
+    uint64_t total;
+    uint32_t *out;
+    unsigned threads;
+    size_t i;
+
+    if (map_files(filenames, nfiles, populate, sequential, maps, lengths, &total) != 0) {
+        free(lengths);
+        free(maps);
+        return 1;
+    }
+    for (i=0; i<nfiles; i++) {
+        if (longest < lengths[i])
+            longest = lengths[i];
+    }
+    out = malloc(parse_ip_parallel_max(longest) * sizeof(*out));
+
+    for (threads=1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        char name[16];
+        unsigned checksum = 0;
+        uint64_t count = 0;
+
+        bench_ctx *ctx = bench_start();
+        for (i=0; i<nfiles; i++) {
+            size_t n = parse_ip_parallel(maps[i], lengths[i], streamer, threads, ordered, out);
+            sum_addresses(out, n, &checksum);
+            count += n;
+        }
+        bench_result_t counters = bench_stop(ctx);
+        snprintf(name, sizeof(name), "thr%3u", threads);
+        print_file_result(name, counters, count, total, checksum);
+
+        ctx = bench_start();
+        for (i=0; i<nfiles; i++)
+            parse_ip_parallel(maps[i], lengths[i], touch_streamer, threads, 0, out);
+        counters = bench_stop(ctx);
+        snprintf(name, sizeof(name), "mem%3u", threads);
+        printf("[%6s] %.3f seconds, %.2f GB/s reading memory\n", name,
+               counters.elapsed_seconds, total / counters.elapsed_seconds / 1000000000.0);
+
+        if (threads >= max_threads)
+            break;
+    }
+
+    unmap_files(maps, lengths, nfiles);
+    free(out);
+    free(lengths);
+    free(maps);
+    return 0;
+}
+
+/**
+ * Parses the files by reading them, with double-buffered `read()`s,
+ * or with `io_uring` if `uring` is set.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_files_read(char **filenames, size_t nfiles, STREAMER streamer, int uring) {
+    unsigned checksum = 0;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    size_t i;
+
+    if (uring && !parse_ip_uring_available())
+        fprintf(stderr, "[-] io_uring isn't available, using read()\n");
+
+    bench_ctx *ctx = bench_start();
+    for (i=0; i<nfiles; i++) {
+        unsigned long long bytes;
+        long long n;
+        int fd = open(filenames[i], O_RDONLY);
+
+        if (fd < 0) {
+            perror(filenames[i]);
+            bench_stop(ctx);
+            return 1;
+        }
+        if (uring)
+            n = parse_ip_uring(fd, streamer, sum_addresses, &checksum, &bytes);
+        else
+            n = parse_ip_fd(fd, streamer, sum_addresses, &checksum, &bytes);
+        if (n < 0) {
+            perror(filenames[i]);
+            close(fd);
+            bench_stop(ctx);
+            return 1;
+        }
+        close(fd);
+        count += (uint64_t)n;
+        total += bytes;
+    }
+    bench_result_t counters = bench_stop(ctx);
+
+    print_file_result(uring ? "uring " : " read ", counters, count, total, checksum);
+    return 0;
+}
+
+/*
+ * The sink for `--output`: sums the addresses for the checksum, and
+ * hands them on to be written.
+ */
+struct convert {
+    unsigned checksum;
+    struct ipfile_writer *writer;
+};
+
+static void
+sum_and_write(const uint32_t *addresses, size_t count, void *arg) {
+    struct convert *cv = arg;
+
+    sum_addresses(addresses, count, &cv->checksum);
+    ipfile_sink(addresses, count, cv->writer);
+}
+
+/**
+ * Converts text files (or stdin, if there are none) to one packed
+ * binary file (see `src/ipfile.c`), read with double-buffered
+ * `read()`s. The time includes writing the output.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_convert(char **filenames, size_t nfiles, STREAMER streamer, const char *output, int network_order) {
+    struct convert cv;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    int result = 0;
+    size_t i;
+
+    cv.checksum = 0;
+    cv.writer = ipfile_create(output, network_order);
+    if (cv.writer == NULL) {
+        perror(output);
+        return 1;
+    }
+
+    bench_ctx *ctx = bench_start();
+    for (i=0; i<(nfiles ? nfiles : 1); i++) {
+        const char *filename = nfiles ? filenames[i] : "stdin";
+        unsigned long long bytes;
+        long long n;
+        int fd = nfiles ? open(filename, O_RDONLY) : 0;
+
+        if (fd < 0) {
+            perror(filename);
+            result = 1;
+            break;
+        }
+        n = parse_ip_fd(fd, streamer, sum_and_write, &cv, &bytes);
+        if (nfiles)
+            close(fd);
+        if (n < 0) {
+            perror(filename);
+            result = 1;
+            break;
+        }
+        count += (uint64_t)n;
+        total += bytes;
+    }
+    if (ipfile_finish(cv.writer) != 0) {
+        perror(output);
+        result = 1;
+    }
+    bench_result_t counters = bench_stop(ctx);
+
+    if (result == 0)
+        print_file_result("write ", counters, count, total, cv.checksum);
+    return result;
+}
+
+/**
+ * Times reading back a packed binary file, the way a later job would
+ * use it instead of the text: mapped, and summed where it is. The sum
+ * must match the checksum in the header.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_packed(const char *filename) {
+    unsigned checksum = 0;
+    unsigned expected;
+    uint64_t count;
+    uint64_t i;
+    int network_order;
+    const uint32_t *addresses = ipfile_map(filename, &count, &network_order, &expected);
+
+    if (addresses == NULL) {
+        perror(filename);
+        return 1;
+    }
+
+    bench_ctx *ctx = bench_start();
+    if (network_order) {
+        for (i=0; i<count; i++)
+            checksum += __builtin_bswap32(addresses[i]);
+    } else {
+        for (i=0; i<count; i++)
+            checksum += addresses[i];
+    }
+    bench_result_t counters = bench_stop(ctx);
+
+    print_file_header(filename);
+    print_file_result("packed", counters, count, 32 + count * 4, checksum);
+    ipfile_unmap(addresses, count);
+    if (checksum != expected) {
+        fprintf(stderr, "[-] %s: checksum is 0x%08x, header says 0x%08x\n", filename, checksum, expected);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Times sorting the addresses in a packed binary file, with duplicates
+ * removed, on `threads` threads, with each size of radix digit. This
+ * is for real lists, far bigger than the benchmark's.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_packed_sort(const char *filename, unsigned threads) {
+    static const unsigned digit_bits[] = {8, 11};
+    uint64_t count;
+    uint64_t i;
+    int network_order;
+    unsigned expected;
+    const uint32_t *addresses = ipfile_map(filename, &count, &network_order, &expected);
+    uint32_t *a;
+    uint32_t *tmp;
+    size_t k;
+
+    if (addresses == NULL) {
+        perror(filename);
+        return 1;
+    }
+    a = malloc(count * sizeof(*a) + 1);
+    tmp = malloc(count * sizeof(*tmp) + 1);
+
+    print_file_header(filename);
+    for (k=0; k<sizeof(digit_bits)/sizeof(digit_bits[0]); k++) {
+        char name[16];
+        unsigned checksum = 0;
+        size_t unique;
+
+        /* Loading isn't part of the timing */
+        for (i=0; i<count; i++)
+            a[i] = network_order ? __builtin_bswap32(addresses[i]) : addresses[i];
+
+        bench_ctx *ctx = bench_start();
+        unique = ip_radix_sort(a, count, tmp, digit_bits[k], threads, 1);
+        bench_result_t counters = bench_stop(ctx);
 
+        for (i=0; i<unique; i++)
+            checksum += a[i];
+        snprintf(name, sizeof(name), "rdx%3u", digit_bits[k]);
+        print_file_result(name, counters, count, count * 4, checksum);
+        printf("%8s %llu unique\n", "", (unsigned long long)unique);
+    }
+
+    free(tmp);
+    free(a);
+    ipfile_unmap(addresses, count);
+    return 0;
+}
 
 /*
- * These are the prototypes/declarations for the various parser
- * algorithms held in other files.
+ * The kinds of `struct ipset`, in the order of `enum ipset_kind`.
  */
-size_t parse_ip_ai(const char *buf, size_t maxlen, uint32_t *out);
-size_t parse_ip_fromchars(const char *buf, size_t maxlen, uint32_t *out);
-size_t parse_ip_swar(const char *buf, size_t maxlen, uint32_t *out);
-size_t parse_ip_neon(const char *buf, size_t maxlen, uint32_t *out);
-size_t parse_ip_fsm(const char *buf, size_t maxlen, uint32_t *out);
-size_t parse_ip_fsm2(const char *buf, size_t maxlen, uint32_t *out);
-size_t parse_ip_dfa(const char *buf, size_t maxlen, uint32_t *out);
-void parse_ip_dfa_init(void);
+static const char *const ipset_names[] = {"bitmap", "ranges", "roarng"};
+
+/*
+ * A sink that keeps all the addresses, for `--set --file`.
+ */
+struct address_list {
+    uint32_t *addresses;
+    size_t count;
+    size_t capacity;
+};
+
+static void
+collect_addresses(const uint32_t *addresses, size_t count, void *arg) {
+    struct address_list *list = arg;
+
+    if (list->count + count > list->capacity) {
+        while (list->count + count > list->capacity)
+            list->capacity = list->capacity * 2 + 65536;
+        list->addresses = realloc(list->addresses, list->capacity * sizeof(*list->addresses));
+    }
+    memcpy(list->addresses + list->count, addresses, count * sizeof(*addresses));
+    list->count += count;
+}
 
 /**
- * This is a traditional LCG random number generator. I want
- * it to return a full 32-bits of randomnous so one call generates
- * an address (instead of building addresses from multiple calls).
- * The point is to use a DETERMINISTIC random number generator
- * so the same seed always produces the same sequence of
- * numbers. This makes test reproducibility easier.
+ * Parses all the addresses in the files into `list`.
+ * @returns 0 on success, 1 on error
  */
-uint32_t lcg32(uint64_t *state) {
-    uint64_t product = *state * 6364136223846793005ULL + 1442695040888963407ULL;
-    *state = product;  /* Full 64-bit state for better quality */
-    return product >> 32;
+static int
+read_addresses(char **filenames, size_t nfiles, STREAMER streamer, struct address_list *list) {
+    size_t i;
+
+    for (i=0; i<nfiles; i++) {
+        unsigned long long bytes;
+        long long n;
+        int fd = open(filenames[i], O_RDONLY);
+
+        if (fd < 0) {
+            perror(filenames[i]);
+            return 1;
+        }
+        n = parse_ip_fd(fd, streamer, collect_addresses, list, &bytes);
+        close(fd);
+        if (n < 0) {
+            perror(filenames[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Times each kind of `struct ipset` holding `list`: building it, as
+ * two halves merged into one, then `lookups` lookups, of which half
+ * are addresses from the list and half are random. The checksum is
+ * how far the number found is from a plain binary search's.
+ */
+static void
+run_sets_list(const uint32_t *list, size_t count, size_t lookups, const char *title) {
+    enum { BATCH = 4096 };
+    uint32_t *queries = malloc(lookups * sizeof(*queries));
+    uint32_t *sorted = malloc(count * sizeof(*sorted) + 1);
+    uint32_t *tmp = malloc(count * sizeof(*tmp) + 1);
+    uint8_t results[BATCH];
+    uint64_t seed = 2;
+    size_t expected = 0;
+    size_t unique;
+    size_t i;
+    int kind;
+
+    for (i=0; i<lookups; i++) {
+        uint32_t r = lcg32(&seed);
+        queries[i] = (i & 1) && count ? list[r % count] : r;
+    }
+    memcpy(sorted, list, count * sizeof(*sorted));
+    unique = ip_radix_sort(sorted, count, tmp, 11, 1, 1);
+    for (i=0; i<lookups; i++)
+        expected += bsearch(&queries[i], sorted, unique, sizeof(*sorted), compare_addresses) != NULL;
+
+    print_file_header(title);
+    for (kind=0; kind<3; kind++) {
+        struct ipset *a;
+        struct ipset *b;
+        size_t hits = 0;
+
+        bench_ctx *ctx = bench_start();
+        a = ipset_create(kind);
+        b = ipset_create(kind);
+        if (a == NULL || b == NULL) {
+            fprintf(stderr, "[-] %s: out of memory\n", ipset_names[kind]);
+            ipset_free(a);
+            ipset_free(b);
+            bench_stop(ctx);
+            continue;
+        }
+        ipset_insert(a, list, count / 2);
+        ipset_insert(b, list + count / 2, count - count / 2);
+        ipset_merge(a, b);
+        ipset_free(b);
+        bench_result_t build = bench_stop(ctx);
+
+        ctx = bench_start();
+        for (i=0; i<lookups; i += BATCH) {
+            size_t n = lookups - i < BATCH ? lookups - i : BATCH;
+            hits += ipset_contains(a, queries + i, n, results);
+        }
+        bench_result_t counters = bench_stop(ctx);
+
+        print_result(ipset_names[kind], counters, lookups, (unsigned)(hits - expected));
+        printf("%8s %llu unique, built in %.3f seconds, %.1f MB\n", "",
+               (unsigned long long)unique, build.elapsed_seconds, ipset_memory(a) / 1000000.0);
+        ipset_free(a);
+    }
+    free(tmp);
+    free(sorted);
+    free(queries);
+}
+
+/**
+ * Times each kind of `struct ipset` holding the CIDR blocks, ranges,
+ * and addresses listed in `blocks`, one per line, parsed with
+ * `parse_cidr_fsm()`. It's built with `ipset_insert_ranges()`, then
+ * looks up the addresses in the files, or 10 million random ones.
+ * The checksum is how far the number found is from a binary search
+ * of the merged ranges.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_sets_blocks(const char *blocks, char **filenames, size_t nfiles, STREAMER streamer) {
+    enum { BATCH = 4096 };
+    struct address_list firsts = {NULL, 0, 0};
+    struct address_list lasts = {NULL, 0, 0};
+    struct address_list queries = {NULL, 0, 0};
+    uint64_t *merged;
+    uint8_t results[BATCH];
+    char token[64];
+    size_t bad = 0;
+    size_t nmerged = 0;
+    size_t expected = 0;
+    size_t i;
+    int kind;
+    FILE *fp = fopen(blocks, "r");
+
+    if (fp == NULL) {
+        perror(blocks);
+        return 1;
+    }
+    while (fscanf(fp, "%63s", token) == 1) {
+        uint32_t first, last;
+        size_t length = strlen(token);
+
+        if (parse_cidr_fsm(token, length, &first, &last) != length) {
+            bad++;
+            continue;
+        }
+        collect_addresses(&first, 1, &firsts);
+        collect_addresses(&last, 1, &lasts);
+    }
+    fclose(fp);
+
+    if (nfiles) {
+        if (read_addresses(filenames, nfiles, streamer, &queries) != 0) {
+            free(queries.addresses);
+            free(lasts.addresses);
+            free(firsts.addresses);
+            return 1;
+        }
+    } else {
+        uint64_t seed = 2;
+        queries.addresses = malloc(10000000 * sizeof(*queries.addresses));
+        for (queries.count=0; queries.count<10000000; queries.count++)
+            queries.addresses[queries.count] = lcg32(&seed);
+    }
+
+    /* The answers, from the ranges sorted and merged, first in the
+     * high half of each word */
+    merged = malloc(firsts.count * sizeof(*merged) + 1);
+    for (i=0; i<firsts.count; i++)
+        merged[i] = (uint64_t)firsts.addresses[i] << 32 | lasts.addresses[i];
+    qsort(merged, firsts.count, sizeof(*merged), compare_ranges);
+    for (i=0; i<firsts.count; i++) {
+        if (nmerged && (merged[nmerged - 1] & 0xFFFFFFFF) + 1 >= merged[i] >> 32) {
+            if ((merged[nmerged - 1] & 0xFFFFFFFF) < (merged[i] & 0xFFFFFFFF))
+                merged[nmerged - 1] = (merged[nmerged - 1] & ~0xFFFFFFFFULL) | (merged[i] & 0xFFFFFFFF);
+        } else
+            merged[nmerged++] = merged[i];
+    }
+    for (i=0; i<queries.count; i++) {
+        uint64_t key = (uint64_t)queries.addresses[i] << 32 | 0xFFFFFFFF;
+        size_t lo = 0, hi = nmerged;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (merged[mid] <= key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        expected += lo && (merged[lo - 1] & 0xFFFFFFFF) >= queries.addresses[i];
+    }
+
+    snprintf(token, sizeof(token), "%llu blocks", (unsigned long long)firsts.count);
+    print_file_header(token);
+    if (bad)
+        printf("%8s %llu lines skipped, not a block, range, or address\n", "", (unsigned long long)bad);
+    for (kind=0; kind<3; kind++) {
+        struct ipset *a;
+        size_t hits = 0;
+
+        bench_ctx *ctx = bench_start();
+        a = ipset_create(kind);
+        if (a == NULL) {
+            fprintf(stderr, "[-] %s: out of memory\n", ipset_names[kind]);
+            bench_stop(ctx);
+            continue;
+        }
+        ipset_insert_ranges(a, firsts.addresses, lasts.addresses, firsts.count);
+        bench_result_t build = bench_stop(ctx);
+
+        ctx = bench_start();
+        for (i=0; i<queries.count; i += BATCH) {
+            size_t n = queries.count - i < BATCH ? queries.count - i : BATCH;
+            hits += ipset_contains(a, queries.addresses + i, n, results);
+        }
+        bench_result_t counters = bench_stop(ctx);
+
+        print_result(ipset_names[kind], counters, queries.count, (unsigned)(hits - expected));
+        printf("%8s %llu of %llu found, built in %.3f seconds, %.1f MB\n", "",
+               (unsigned long long)hits, (unsigned long long)queries.count,
+               build.elapsed_seconds, ipset_memory(a) / 1000000.0);
+        ipset_free(a);
+    }
+    free(merged);
+    free(queries.addresses);
+    free(lasts.addresses);
+    free(firsts.addresses);
+    return 0;
 }
 
+/**
+ * Benchmarks the kinds of `struct ipset` on lists of random addresses
+ * of several sizes, or on the addresses parsed from files.
+ * @returns 0 on success, 1 on error
+ */
+static int
+run_sets(char **filenames, size_t nfiles, STREAMER streamer) {
+    static const size_t sizes[] = {1000, 100000, 10000000};
+    const size_t lookups = 10000000;
+    size_t i;
+
+    if (nfiles) {
+        struct address_list list = {NULL, 0, 0};
+        char title[64];
+
+        if (read_addresses(filenames, nfiles, streamer, &list) != 0) {
+            free(list.addresses);
+            return 1;
+        }
+        snprintf(title, sizeof(title), "%llu addresses", (unsigned long long)list.count);
+        run_sets_list(list.addresses, list.count, lookups, title);
+        free(list.addresses);
+        return 0;
+    }
 
+    for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+        uint32_t *list = malloc(sizes[i] * sizeof(*list));
+        uint64_t seed = 1;
+        char title[64];
+        size_t k;
+
+        for (k=0; k<sizes[i]; k++)
+            list[k] = lcg32(&seed);
+        snprintf(title, sizeof(title), "%llu addresses", (unsigned long long)sizes[i]);
+        run_sets_list(list, sizes[i], lookups, title);
+        free(list);
+    }
+    return 0;
+}
 
 /*
- * All the parser functions must conform to this prototype.
- * @returns
- *  >0 : number of bytes consumed, not including delimeter
- *   0 : parse failure
+ * The kinds of `struct agg` for `--count`, in the order of `enum agg_kind`.
  */
-typedef size_t (*PARSER)(const char *buf, size_t maxlen, uint32_t *out);
+static const char *const agg_names[] = {"24", "ip", "top"};
 
 /**
- * This function benchmarks a single parser algorithm. It's called multiple
- *  times, for different algorithms, and different sized test buffers.
+ * Counts the addresses in the files, or stdin, per address or per
+ * /24, as they're parsed, and prints the 20 with the most hits.
+ * @returns 0 on success, 1 on error
  */
-static void
-run_benchmark(const char *test, size_t N, size_t C, const char *name, PARSER parser, unsigned in_sum) {
-    unsigned checksum;
-    size_t repeat;
+static int
+run_count(char **filenames, size_t nfiles, STREAMER streamer, int kind) {
+    enum { TOP = 20 };
+    struct agg *a = agg_create(kind, 10000);
+    unsigned long long total_bytes = 0;
+    uint32_t keys[TOP];
+    uint64_t counts[TOP];
+    uint64_t errors[TOP];
+    size_t found;
     size_t i;
-    const uint64_t iterations = N * C;
-    
-    /*
-     * This variable does two things. First, it'll act as a
-     * 'sink' to prevent optimizers removing code that
-     * doens't contribute to a result. Second, it verifies
-     * that the parsers are working correctly: if there
-     * is a subtle bug in parsing addresses, this will
-     * detect it.
-     */
-    checksum = 0;
-    
-    /*
-     * Run the benchmarked code `C` times.
-     * Each run parses `N` addresses.
-     */
+
+    if (a == NULL) {
+        fprintf(stderr, "[-] out of memory\n");
+        return 1;
+    }
     bench_ctx *ctx = bench_start();
-    for (repeat=0; repeat<C; repeat++) {
-        for (i=0; i<N; i++) {
-            unsigned ip_address;
-            parser(test + i*16, 16, &ip_address);
-            checksum += ip_address;
+    for (i=0; i<(nfiles ? nfiles : 1); i++) {
+        unsigned long long bytes;
+        long long n;
+        int fd = nfiles ? open(filenames[i], O_RDONLY) : 0;
+
+        if (fd < 0) {
+            perror(filenames[i]);
+            bench_stop(ctx);
+            agg_free(a);
+            return 1;
+        }
+        n = parse_ip_fd(fd, streamer, agg_sink, a, &bytes);
+        if (nfiles)
+            close(fd);
+        if (n < 0) {
+            perror(nfiles ? filenames[i] : "stdin");
+            bench_stop(ctx);
+            agg_free(a);
+            return 1;
         }
+        total_bytes += bytes;
     }
-#if defined(__APPLE__)
-    usleep(100);
-#endif
     bench_result_t counters = bench_stop(ctx);
 
-    printf("[%6s] %5.1f-GHz %5.1f-ns %4llu %4llu %4.1f %4llu %4.1f %4.1f    [0x%08x]\n", name,
-           counters.cycles/counters.elapsed_seconds/1000000000.0,
-           1000000000.0 * counters.elapsed_seconds/iterations,
-           counters.cycles/iterations,
-           counters.instructions/iterations,
-           1.0 * counters.instructions/counters.cycles,
-           counters.branches/iterations,
-           1.0 * counters.branch_misses/iterations,
-           1.0 * counters.l1d_misses/iterations,
-           checksum - in_sum
-           );
+    print_file_header(nfiles == 1 ? filenames[0] : nfiles ? "files" : "stdin");
+    print_file_result(" count", counters, agg_total(a), total_bytes, 0);
+    printf("%8s %.1f MB of counters\n", "", agg_memory(a) / 1000000.0);
+    found = agg_top(a, TOP, keys, counts, errors);
+    for (i=0; i<found; i++) {
+        char address[32];
+        snprintf(address, sizeof(address), "%u.%u.%u.%u%s",
+                 keys[i] >> 24, (keys[i] >> 16) & 0xFF, (keys[i] >> 8) & 0xFF, keys[i] & 0xFF,
+                 kind == AGG_PER24 ? "/24" : "");
+        if (errors[i])
+            printf("%8s %-18s %12llu (may be %llu too high)\n", "", address,
+                   (unsigned long long)counts[i], (unsigned long long)errors[i]);
+        else
+            printf("%8s %-18s %12llu\n", "", address, (unsigned long long)counts[i]);
+    }
+    agg_free(a);
+    return 0;
 }
 
 /**
- * Creates a test-case buffer printing random IPv4 addresses into a
- * buffer separated by one or more spaces.
- *
- * Kludge: we are padding every address to 16-bytes, so they
- * are located at 16-byte boundaries.
+ * Parses the addresses piped into stdin, which can't be mapped, so
+ * they're read through the double-buffering in `ingest.c`.
+ * @returns 0 on success, 1 on error
  */
-static char *
-create_test_case(size_t *length, size_t N, uint64_t seed) {
-    size_t i;
-    size_t offset = *length;
-    char* test = malloc(1);
-    *test = '\0';
+static int
+run_stdin(STREAMER streamer) {
+    unsigned checksum = 0;
+    unsigned long long bytes;
+    long long count;
 
-    /*
-     * Create `N` addresses
-     */
-    for (i=0; i<N; i++) {
-        unsigned ip_address;
-        char buf[64];
-        size_t ip_length;
-     
-        /* Generate a random IPv4 address, 32-bits in size */
-        ip_address = lcg32(&seed);
-        
-        /* Print to a temporary string */
-        snprintf(buf, sizeof(buf), "%u.%u.%u.%u         ",
-                 (ip_address>>24)&0xFF,
-                 (ip_address>>16)&0xFF,
-                 (ip_address>> 8)&0xFF,
-                 (ip_address>> 0)&0xFF);
-        buf[16] = '\0'; /* truncate to only 16 bytes */
-        
-        ip_length = strlen(buf); /* should be 16 */
-        
-        /* Make sure we have enough memory, otherwise, expand
-         * the buffer */
-        while (offset + ip_length + 1 >= *length) {
-            *length = *length * 2 + 1;
-            test = realloc(test, *length);
-        }
-        
-        /* Append */
-        memcpy(test + offset, buf, ip_length+1);
+    bench_ctx *ctx = bench_start();
+    count = parse_ip_fd(0, streamer, sum_addresses, &checksum, &bytes);
+    bench_result_t counters = bench_stop(ctx);
 
-        offset += ip_length;
+    if (count < 0) {
+        perror("stdin");
+        return 1;
     }
+    print_file_header("stdin");
+    print_file_result("stdin ", counters, (uint64_t)count, bytes, checksum);
+    return 0;
+}
 
-    *length = offset;
-    return test;
+#ifndef FASTAI
+/**
+ * Times `ingest.c` reading `text` back from a temporary file with
+ * `read()`, and parsing it with `streamer`, a chunk at a time.
+ */
+static void
+run_benchmark_ingest(const char *text, size_t length, const char *name, STREAMER streamer, unsigned in_sum) {
+    unsigned checksum = 0;
+    unsigned long long bytes;
+    long long count;
+    FILE *fp = tmpfile();
+
+    if (fp == NULL || fwrite(text, 1, length, fp) != length || fflush(fp) != 0) {
+        perror("tmpfile");
+        if (fp)
+            fclose(fp);
+        return;
+    }
+    lseek(fileno(fp), 0, SEEK_SET);
+
+    bench_ctx *ctx = bench_start();
+    count = parse_ip_fd(fileno(fp), streamer, sum_addresses, &checksum, &bytes);
+    bench_result_t counters = bench_stop(ctx);
+
+    print_result(name, counters, count > 0 ? (uint64_t)count : 1, checksum - in_sum);
+    fclose(fp);
+}
+#endif
+#endif
+
+static void
+usage(const char *progname) {
+    fprintf(stderr, "usage: %s [--file <filename>]... [--io mmap|read|uring|all] [--populate] [--sequential] [--parser <name>]\n", progname);
+    fprintf(stderr, "       %s [--file <filename>]... --threads <n>|all [--unordered] [--populate] [--sequential] [--parser <name>]\n", progname);
+    fprintf(stderr, "       %s --stdin [--parser <name>]\n", progname);
+    fprintf(stderr, "       %s [--file <filename>]... | --stdin --output <filename> [--network] [--parser <name>]\n", progname);
+    fprintf(stderr, "       %s --packed <filename> [--sort [--threads <n>|all]]\n", progname);
+    fprintf(stderr, "       %s --set [--blocks <filename>] [--file <filename>]... [--parser <name>]\n", progname);
+    fprintf(stderr, "       %s [--file <filename>]... | --stdin --count ip|24|top [--parser <name>]\n", progname);
+#if HAVE_MMAP
+    {
+        size_t i;
+        fprintf(stderr, "parsers:");
+        for (i=0; i<sizeof(file_parsers)/sizeof(file_parsers[0]); i++)
+            fprintf(stderr, " %s", file_parsers[i].name);
+        fprintf(stderr, " (default: %s)\n", file_parsers[0].name);
+    }
+#endif
 }
 
+/**
+ * Parses the `--file` and `--stdin` options, and runs them.
+ * @returns the exit code
+ */
+static int
+file_main(int argc, char *argv[]) {
+    char **filenames = calloc((size_t)argc, sizeof(*filenames));
+    size_t nfiles = 0;
+    const char *parser_name = NULL;
+    const char *io = "mmap";
+    int populate = 0;
+    int sequential = 0;
+    int use_stdin = 0;
+    unsigned threads = 0;
+    int ordered = 1;
+    const char *output = NULL;
+    const char *packed = NULL;
+    int network_order = 0;
+    int sort = 0;
+    int set = 0;
+    const char *blocks = NULL;
+    int count_kind = -1;
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc)
+            filenames[nfiles++] = argv[++i];
+        else if (strcmp(argv[i], "--stdin") == 0)
+            use_stdin = 1;
+        else if (strcmp(argv[i], "--parser") == 0 && i + 1 < argc)
+            parser_name = argv[++i];
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc)
+            io = argv[++i];
+        else if (strcmp(argv[i], "--populate") == 0)
+            populate = 1;
+        else if (strcmp(argv[i], "--sequential") == 0)
+            sequential = 1;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            i++;
+#if HAVE_MMAP
+            if (strcmp(argv[i], "all") == 0)
+                threads = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+            else
+#endif
+                threads = (unsigned)strtoul(argv[i], NULL, 0);
+            if (threads == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--unordered") == 0)
+            ordered = 0;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--network") == 0)
+            network_order = 1;
+        else if (strcmp(argv[i], "--packed") == 0 && i + 1 < argc)
+            packed = argv[++i];
+        else if (strcmp(argv[i], "--sort") == 0)
+            sort = 1;
+        else if (strcmp(argv[i], "--set") == 0)
+            set = 1;
+        else if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc)
+            blocks = argv[++i];
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            i++;
+            for (count_kind=0; count_kind<3 && strcmp(argv[i], agg_names[count_kind]) != 0; count_kind++)
+                ;
+            if (count_kind == 3) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (packed && nfiles == 0 && !use_stdin) {
+#if HAVE_MMAP
+        free(filenames);
+        if (sort)
+            return run_packed_sort(packed, threads ? threads : 1);
+        return run_packed(packed);
+#endif
+    } else if (((nfiles == 0) == !use_stdin && !set) || (set && use_stdin) || (blocks && !set) || packed
+        || (strcmp(io, "mmap") && strcmp(io, "read") && strcmp(io, "uring") && strcmp(io, "all"))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+#if HAVE_MMAP
+    {
+        const size_t count = sizeof(file_parsers)/sizeof(file_parsers[0]);
+        STREAMER streamer;
+        int all = strcmp(io, "all") == 0;
+        int result = 0;
+        size_t k = 0;
 
-int main(void) {
+        if (parser_name) {
+            for (k=0; k<count && strcmp(parser_name, file_parsers[k].name) != 0; k++)
+                ;
+            if (k == count) {
+                fprintf(stderr, "[-] unknown parser: %s\n", parser_name);
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        streamer = file_parsers[k].streamer;
+        if (streamer == parse_ip_stream_dfa)
+            parse_ip_dfa_init();
+#if defined(__x86_64__) || defined(__i386__)
+        if (streamer == parse_ip_stream_sse
+            && !(__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt"))) {
+            fprintf(stderr, "[-] the sse parser needs SSE4.1\n");
+            return 1;
+        }
+#endif
+        if (set) {
+            if (blocks)
+                result = run_sets_blocks(blocks, filenames, nfiles, streamer);
+            else
+                result = run_sets(filenames, nfiles, streamer);
+            free(filenames);
+            return result;
+        }
+        if (count_kind >= 0) {
+            result = run_count(filenames, use_stdin ? 0 : nfiles, streamer, count_kind);
+            free(filenames);
+            return result;
+        }
+        if (output) {
+            print_file_header(output);
+            result = run_convert(filenames, nfiles, streamer, output, network_order);
+            free(filenames);
+            return result;
+        }
+        if (use_stdin)
+            return run_stdin(streamer);
+        if (threads) {
+            print_file_header(nfiles == 1 ? filenames[0] : "parallel");
+            result = run_files_parallel(filenames, nfiles, streamer, populate, sequential, threads, ordered);
+            free(filenames);
+            return result;
+        }
+
+        if (nfiles == 1)
+            print_file_header(filenames[0]);
+        else {
+            char title[64];
+            snprintf(title, sizeof(title), "%llu files", (unsigned long long)nfiles);
+            print_file_header(title);
+        }
+        if (all || strcmp(io, "mmap") == 0)
+            result |= run_files_mmap(filenames, nfiles, streamer, populate, sequential);
+        if (all || strcmp(io, "read") == 0)
+            result |= run_files_read(filenames, nfiles, streamer, 0);
+        if (all || strcmp(io, "uring") == 0)
+            result |= run_files_read(filenames, nfiles, streamer, 1);
+        free(filenames);
+        return result;
+    }
+#else
+    (void)parser_name; (void)populate; (void)sequential; (void)threads; (void)ordered;
+    (void)output; (void)network_order; (void)sort; (void)set; (void)blocks; (void)count_kind;
+    fprintf(stderr, "[-] --file and --stdin need POSIX\n");
+    return 1;
+#endif
+}
+
+int main(int argc, char *argv[]) {
     static const int N = 1500; /* size of test case */
     static const int C = 100; /* count of test cases to run */
     char *test;
     size_t test_length = 0;
-    
+#ifndef FASTAI
+    char *stream;
+    size_t stream_length;
+    char *stream_big;
+    size_t stream_big_length;
+    char *logs;
+    size_t logs_length;
+    char *logs_big;
+    size_t logs_big_length;
+    char *cidrs;
+    char *routes;
+    char *tight;
+    unsigned char *tight_lengths;
+#if HAVE_MMAP
+    struct guard_case guard;
+    char *straddle;
+    size_t straddle_length;
+#endif
+#endif
+
+    /*
+     * With options, parse a real file instead of running the
+     * benchmarks.
+     */
+    if (argc > 1)
+        return file_main(argc, argv);
+
     /*
-     * We need to initialize the tables for this algorithm.
+     * We need to initialize the tables for these algorithms.
      */
     parse_ip_dfa_init();
+    parse_ip_shape_init();
+    parse_ip_scan_init();
+    format_ip_init();
     
 
     /*
@@ -175,6 +2330,20 @@ int main(void) {
      * number of IPv4 addresses separated by spaces.
      */
     test = create_test_case(&test_length, N*100, 1);
+#ifndef FASTAI
+    stream = create_stream_case(&stream_length, N, 1);
+    stream_big = create_stream_case(&stream_big_length, N*100, 1);
+    logs = create_log_case(&logs_length, N, 1);
+    logs_big = create_log_case(&logs_big_length, N*100, 1);
+    cidrs = create_cidr_case(N*100, 1);
+    routes = create_route_case(1000000, 2);
+    tight_lengths = malloc(N);
+    tight = create_tight_case(tight_lengths, N, 1);
+#if HAVE_MMAP
+    guard = create_guard_case(N, 1);
+    straddle = create_straddle_case(&straddle_length, logs_big, logs_big_length);
+#endif
+#endif
 
     /*
      * Sets a higher priority thread. On macOS, this likely
@@ -201,14 +2370,131 @@ int main(void) {
     run_benchmark(test, N, C*100, " from ", parse_ip_fromchars, 0x26f598c0);
     run_benchmark(test, N*100, C, " from+", parse_ip_fromchars, 0xfa929ccc);
 #ifndef FASTAI
+    run_benchmark(test, N, C*100, "swar2 ", parse_ip_swar2, 0x26f598c0);
+    run_benchmark(test, N*100, C, "swar2+", parse_ip_swar2, 0xfa929ccc);
+#if HAVE_MMAP
+    run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, " swar|", parse_ip_swar, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_START, " swar<", parse_ip_swar, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_END, " swar>", parse_ip_swar, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, "swar2|", parse_ip_swar2, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_START, "swar2<", parse_ip_swar2, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_END, "swar2>", parse_ip_swar2, 0x26f598c0);
+#endif
     run_benchmark(test, N, C*100, "  dfa ", parse_ip_dfa, 0x26f598c0);
     run_benchmark(test, N*100, C, "  dfa+", parse_ip_dfa, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " dfac ", parse_ip_dfa_compact, 0x26f598c0);
+    run_benchmark(test, N*100, C, " dfac+", parse_ip_dfa_compact, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " dfag ", parse_ip_dfagen, 0x26f598c0);
+    run_benchmark(test, N*100, C, " dfag+", parse_ip_dfagen, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " dfa2 ", parse_ip_dfa_pair, 0x26f598c0);
+    run_benchmark(test, N*100, C, " dfa2+", parse_ip_dfa_pair, 0xfa929ccc);
+    run_benchmark_batch(test, N, C*100, " dfa8 ", parse_ip_dfa_batch, 0x26f598c0);
+    run_benchmark_batch(test, N*100, C, " dfa8+", parse_ip_dfa_batch, 0xfa929ccc);
+    run_benchmark_scan(test, N, C*100, " scan ", parse_ip_scan, 0x26f598c0);
+    run_benchmark_scan(test, N*100, C, " scan+", parse_ip_scan, 0xfa929ccc);
+    run_benchmark_scan_ends(test, N, C*100, " scn1 ");
+    run_benchmark_scan_ends(test, N*100, C, " scn1+");
+    run_benchmark_stream(stream, stream_length, N, C*100, " strs ", parse_ip_stream_scalar, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strs+", parse_ip_stream_scalar, 0xfa929ccc);
+    run_benchmark_stream(stream, stream_length, N, C*100, " strw ", parse_ip_stream_swar, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strw+", parse_ip_stream_swar, 0xfa929ccc);
+    run_benchmark_stream(stream, stream_length, N, C*100, " strd ", parse_ip_stream_dfa, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strd+", parse_ip_stream_dfa, 0xfa929ccc);
+    run_benchmark_stream(stream, stream_length, N, C*100, " strf ", parse_ip_stream_fsm, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strf+", parse_ip_stream_fsm, 0xfa929ccc);
+    run_benchmark_index(stream, stream_length, N, C*100, " idx1 ");
+    run_benchmark_index(stream_big, stream_big_length, N*100, C, " idx1+");
+    run_benchmark_index_parse(stream, stream_length, N, C*100, " idxs ", parse_ip_scalar_len, 0x26f598c0);
+    run_benchmark_index_parse(stream_big, stream_big_length, N*100, C, " idxs+", parse_ip_scalar_len, 0xfa929ccc);
+    run_benchmark_index_parse(stream, stream_length, N, C*100, " idxw ", parse_ip_swar2_len, 0x26f598c0);
+    run_benchmark_index_parse(stream_big, stream_big_length, N*100, C, " idxw+", parse_ip_swar2_len, 0xfa929ccc);
+    run_benchmark_tight(tight, tight_lengths, N, C*100, " lens=", parse_ip_scalar_len, 0x26f598c0);
+    run_benchmark_tight(tight, tight_lengths, N, C*100, " lenw=", parse_ip_swar2_len, 0x26f598c0);
+    run_benchmark_extract(logs, logs_length, N, C*100, " logx ", 0x26f598c0);
+    run_benchmark_extract(logs_big, logs_big_length, N*100, C, " logx+", 0xfa929ccc);
+#if HAVE_MMAP
+    run_benchmark_ingest(straddle, straddle_length, " logi+", parse_ip_stream_extract, 0xc8fb2434);
+#endif
+    run_benchmark_cidr(cidrs, N, C*100, " cfsm ", parse_cidr_fsm, 0x4d43b580);
+    run_benchmark_cidr(cidrs, N*100, C, " cfsm+", parse_cidr_fsm, 0xa0be6ae4);
+    run_benchmark_cidr(cidrs, N, C*100, " cswr ", parse_cidr_swar, 0x4d43b580);
+    run_benchmark_cidr(cidrs, N*100, C, " cswr+", parse_cidr_swar, 0xa0be6ae4);
+    run_benchmark_lpm(routes, 1000000, stream_big, stream_big_length, N, C, 0x6333f060, 0x61b58e84);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " ag24+", AGG_PER24, 1, 0x88916400);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " agip+", AGG_ADDRESS, 1, 0xfa929ccc);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " agia+", AGG_ADDRESS, 0, 0xfa929ccc);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " agtk+", AGG_TOPK, 1, 0);
+    run_benchmark_format(N, C*100, " sprf ", format_ip_snprintf, NULL, 0x26f598c0);
+    run_benchmark_format(N*100, C, " sprf+", format_ip_snprintf, NULL, 0xfa929ccc);
+    run_benchmark_format(N, C*100, " ftab ", format_ip_table, NULL, 0x26f598c0);
+    run_benchmark_format(N*100, C, " ftab+", format_ip_table, NULL, 0xfa929ccc);
+    run_benchmark_format(N, C*100, " fswr ", format_ip_swar, NULL, 0x26f598c0);
+    run_benchmark_format(N*100, C, " fswr+", format_ip_swar, NULL, 0xfa929ccc);
+    run_benchmark_pack(stream_big, stream_big_length, N*100, C, " pkle+", 0, 0xfa929ccc);
+    run_benchmark_pack(stream_big, stream_big_length, N*100, C, " pkbe+", 1, 0xfa929ccc);
+    run_benchmark_packed(stream_big, stream_big_length, N*100, C, " rdle+", 0, 0xfa929ccc);
+    run_benchmark_packed(stream_big, stream_big_length, N*100, C, " rdbe+", 1, 0xfa929ccc);
+    run_benchmark_sort(N*100, C/10, " qsrt+", 0, 1, 1);
+    run_benchmark_sort(N*100, C/10, " rdx8+", 8, 1, 1);
+    run_benchmark_sort(N*100, C/10, " rdxb+", 11, 1, 1);
+    run_benchmark_sort(N*100, C/10, " rdxs+", 11, 1, 0);
+    run_benchmark_sort(N*100, C/10, " rdxt+", 11, 4, 1);
     run_benchmark(test, N, C*100, "  fsm ", parse_ip_fsm, 0x26f598c0);
     run_benchmark(test, N*100, C, "  fsm+", parse_ip_fsm, 0xfa929ccc);
     run_benchmark(test, N, C*100, " fsm2 ", parse_ip_fsm2, 0x26f598c0);
     run_benchmark(test, N*100, C, " fsm2+", parse_ip_fsm2, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " fsmg ", parse_ip_fsm_goto, 0x26f598c0);
+    run_benchmark(test, N*100, C, " fsmg+", parse_ip_fsm_goto, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " fsmt ", parse_ip_fsm_tail, 0x26f598c0);
+    run_benchmark(test, N*100, C, " fsmt+", parse_ip_fsm_tail, 0xfa929ccc);
+#if defined(__ARM_NEON__)
     run_benchmark(test, N, C*100, " neon ", parse_ip_neon, 0x26f598c0);
     run_benchmark(test, N*100, C, " neon+", parse_ip_neon, 0xfa929ccc);
+#if HAVE_MMAP
+    run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, " neon|", parse_ip_neon, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_START, " neon<", parse_ip_neon, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_END, " neon>", parse_ip_neon, 0x26f598c0);
+#endif
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt")) {
+        run_benchmark(test, N, C*100, "  sse ", parse_ip_sse, 0x26f598c0);
+        run_benchmark(test, N*100, C, "  sse+", parse_ip_sse, 0xfa929ccc);
+#if HAVE_MMAP
+        run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, "  sse|", parse_ip_sse, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_START, "  sse<", parse_ip_sse, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_END, "  sse>", parse_ip_sse, 0x26f598c0);
+#endif
+        run_benchmark_stream(stream, stream_length, N, C*100, " strx ", parse_ip_stream_sse, 0x26f598c0);
+        run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strx+", parse_ip_stream_sse, 0xfa929ccc);
+        run_benchmark_index_parse(stream, stream_length, N, C*100, " idxx ", parse_ip_sse_len, 0x26f598c0);
+        run_benchmark_index_parse(stream_big, stream_big_length, N*100, C, " idxx+", parse_ip_sse_len, 0xfa929ccc);
+        run_benchmark_tight(tight, tight_lengths, N, C*100, " lenx=", parse_ip_sse_len, 0x26f598c0);
+        run_benchmark_cidr(cidrs, N, C*100, " csse ", parse_cidr_sse, 0x4d43b580);
+        run_benchmark_cidr(cidrs, N*100, C, " csse+", parse_cidr_sse, 0xa0be6ae4);
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        run_benchmark_format(N, C*100, " fsse ", NULL, format_ip_batch_sse, 0x26f598c0);
+        run_benchmark_format(N*100, C, " fsse+", NULL, format_ip_batch_sse, 0xfa929ccc);
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        run_benchmark(test, N, C*100, "shape ", parse_ip_shape, 0x26f598c0);
+        run_benchmark(test, N*100, C, "shape+", parse_ip_shape, 0xfa929ccc);
+#if HAVE_MMAP
+        run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, "shape|", parse_ip_shape, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_START, "shape<", parse_ip_shape, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_END, "shape>", parse_ip_shape, 0x26f598c0);
+#endif
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        run_benchmark_batch(test, N, C*100, "  ymm ", parse_ip_batch_avx2, 0x26f598c0);
+        run_benchmark_batch(test, N*100, C, "  ymm+", parse_ip_batch_avx2, 0xfa929ccc);
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        run_benchmark_batch(test, N, C*100, "  zmm ", parse_ip_batch_avx512, 0x26f598c0);
+        run_benchmark_batch(test, N*100, C, "  zmm+", parse_ip_batch_avx512, 0xfa929ccc);
+    }
+#endif
 #endif
     printf("\n");
 
@@ -234,14 +2520,131 @@ int main(void) {
     run_benchmark(test, N, C*100, " from ", parse_ip_fromchars, 0x26f598c0);
     run_benchmark(test, N*100, C, " from+", parse_ip_fromchars, 0xfa929ccc);
 #ifndef FASTAI
+    run_benchmark(test, N, C*100, "swar2 ", parse_ip_swar2, 0x26f598c0);
+    run_benchmark(test, N*100, C, "swar2+", parse_ip_swar2, 0xfa929ccc);
+#if HAVE_MMAP
+    run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, " swar|", parse_ip_swar, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_START, " swar<", parse_ip_swar, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_END, " swar>", parse_ip_swar, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, "swar2|", parse_ip_swar2, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_START, "swar2<", parse_ip_swar2, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_END, "swar2>", parse_ip_swar2, 0x26f598c0);
+#endif
     run_benchmark(test, N, C*100, "  dfa ", parse_ip_dfa, 0x26f598c0);
     run_benchmark(test, N*100, C, "  dfa+", parse_ip_dfa, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " dfac ", parse_ip_dfa_compact, 0x26f598c0);
+    run_benchmark(test, N*100, C, " dfac+", parse_ip_dfa_compact, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " dfag ", parse_ip_dfagen, 0x26f598c0);
+    run_benchmark(test, N*100, C, " dfag+", parse_ip_dfagen, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " dfa2 ", parse_ip_dfa_pair, 0x26f598c0);
+    run_benchmark(test, N*100, C, " dfa2+", parse_ip_dfa_pair, 0xfa929ccc);
+    run_benchmark_batch(test, N, C*100, " dfa8 ", parse_ip_dfa_batch, 0x26f598c0);
+    run_benchmark_batch(test, N*100, C, " dfa8+", parse_ip_dfa_batch, 0xfa929ccc);
+    run_benchmark_scan(test, N, C*100, " scan ", parse_ip_scan, 0x26f598c0);
+    run_benchmark_scan(test, N*100, C, " scan+", parse_ip_scan, 0xfa929ccc);
+    run_benchmark_scan_ends(test, N, C*100, " scn1 ");
+    run_benchmark_scan_ends(test, N*100, C, " scn1+");
+    run_benchmark_stream(stream, stream_length, N, C*100, " strs ", parse_ip_stream_scalar, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strs+", parse_ip_stream_scalar, 0xfa929ccc);
+    run_benchmark_stream(stream, stream_length, N, C*100, " strw ", parse_ip_stream_swar, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strw+", parse_ip_stream_swar, 0xfa929ccc);
+    run_benchmark_stream(stream, stream_length, N, C*100, " strd ", parse_ip_stream_dfa, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strd+", parse_ip_stream_dfa, 0xfa929ccc);
+    run_benchmark_stream(stream, stream_length, N, C*100, " strf ", parse_ip_stream_fsm, 0x26f598c0);
+    run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strf+", parse_ip_stream_fsm, 0xfa929ccc);
+    run_benchmark_index(stream, stream_length, N, C*100, " idx1 ");
+    run_benchmark_index(stream_big, stream_big_length, N*100, C, " idx1+");
+    run_benchmark_index_parse(stream, stream_length, N, C*100, " idxs ", parse_ip_scalar_len, 0x26f598c0);
+    run_benchmark_index_parse(stream_big, stream_big_length, N*100, C, " idxs+", parse_ip_scalar_len, 0xfa929ccc);
+    run_benchmark_index_parse(stream, stream_length, N, C*100, " idxw ", parse_ip_swar2_len, 0x26f598c0);
+    run_benchmark_index_parse(stream_big, stream_big_length, N*100, C, " idxw+", parse_ip_swar2_len, 0xfa929ccc);
+    run_benchmark_tight(tight, tight_lengths, N, C*100, " lens=", parse_ip_scalar_len, 0x26f598c0);
+    run_benchmark_tight(tight, tight_lengths, N, C*100, " lenw=", parse_ip_swar2_len, 0x26f598c0);
+    run_benchmark_extract(logs, logs_length, N, C*100, " logx ", 0x26f598c0);
+    run_benchmark_extract(logs_big, logs_big_length, N*100, C, " logx+", 0xfa929ccc);
+#if HAVE_MMAP
+    run_benchmark_ingest(straddle, straddle_length, " logi+", parse_ip_stream_extract, 0xc8fb2434);
+#endif
+    run_benchmark_cidr(cidrs, N, C*100, " cfsm ", parse_cidr_fsm, 0x4d43b580);
+    run_benchmark_cidr(cidrs, N*100, C, " cfsm+", parse_cidr_fsm, 0xa0be6ae4);
+    run_benchmark_cidr(cidrs, N, C*100, " cswr ", parse_cidr_swar, 0x4d43b580);
+    run_benchmark_cidr(cidrs, N*100, C, " cswr+", parse_cidr_swar, 0xa0be6ae4);
+    run_benchmark_lpm(routes, 1000000, stream_big, stream_big_length, N, C, 0x6333f060, 0x61b58e84);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " ag24+", AGG_PER24, 1, 0x88916400);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " agip+", AGG_ADDRESS, 1, 0xfa929ccc);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " agia+", AGG_ADDRESS, 0, 0xfa929ccc);
+    run_benchmark_agg(stream_big, stream_big_length, N*100, C, " agtk+", AGG_TOPK, 1, 0);
+    run_benchmark_format(N, C*100, " sprf ", format_ip_snprintf, NULL, 0x26f598c0);
+    run_benchmark_format(N*100, C, " sprf+", format_ip_snprintf, NULL, 0xfa929ccc);
+    run_benchmark_format(N, C*100, " ftab ", format_ip_table, NULL, 0x26f598c0);
+    run_benchmark_format(N*100, C, " ftab+", format_ip_table, NULL, 0xfa929ccc);
+    run_benchmark_format(N, C*100, " fswr ", format_ip_swar, NULL, 0x26f598c0);
+    run_benchmark_format(N*100, C, " fswr+", format_ip_swar, NULL, 0xfa929ccc);
+    run_benchmark_pack(stream_big, stream_big_length, N*100, C, " pkle+", 0, 0xfa929ccc);
+    run_benchmark_pack(stream_big, stream_big_length, N*100, C, " pkbe+", 1, 0xfa929ccc);
+    run_benchmark_packed(stream_big, stream_big_length, N*100, C, " rdle+", 0, 0xfa929ccc);
+    run_benchmark_packed(stream_big, stream_big_length, N*100, C, " rdbe+", 1, 0xfa929ccc);
+    run_benchmark_sort(N*100, C/10, " qsrt+", 0, 1, 1);
+    run_benchmark_sort(N*100, C/10, " rdx8+", 8, 1, 1);
+    run_benchmark_sort(N*100, C/10, " rdxb+", 11, 1, 1);
+    run_benchmark_sort(N*100, C/10, " rdxs+", 11, 1, 0);
+    run_benchmark_sort(N*100, C/10, " rdxt+", 11, 4, 1);
     run_benchmark(test, N, C*100, "  fsm ", parse_ip_fsm, 0x26f598c0);
     run_benchmark(test, N*100, C, "  fsm+", parse_ip_fsm, 0xfa929ccc);
     run_benchmark(test, N, C*100, " fsm2 ", parse_ip_fsm2, 0x26f598c0);
     run_benchmark(test, N*100, C, " fsm2+", parse_ip_fsm2, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " fsmg ", parse_ip_fsm_goto, 0x26f598c0);
+    run_benchmark(test, N*100, C, " fsmg+", parse_ip_fsm_goto, 0xfa929ccc);
+    run_benchmark(test, N, C*100, " fsmt ", parse_ip_fsm_tail, 0x26f598c0);
+    run_benchmark(test, N*100, C, " fsmt+", parse_ip_fsm_tail, 0xfa929ccc);
+#if defined(__ARM_NEON__)
     run_benchmark(test, N, C*100, " neon ", parse_ip_neon, 0x26f598c0);
     run_benchmark(test, N*100, C, " neon+", parse_ip_neon, 0xfa929ccc);
+#if HAVE_MMAP
+    run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, " neon|", parse_ip_neon, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_START, " neon<", parse_ip_neon, 0x26f598c0);
+    run_benchmark_guard(&guard, N, C*100, GUARD_END, " neon>", parse_ip_neon, 0x26f598c0);
+#endif
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt")) {
+        run_benchmark(test, N, C*100, "  sse ", parse_ip_sse, 0x26f598c0);
+        run_benchmark(test, N*100, C, "  sse+", parse_ip_sse, 0xfa929ccc);
+#if HAVE_MMAP
+        run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, "  sse|", parse_ip_sse, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_START, "  sse<", parse_ip_sse, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_END, "  sse>", parse_ip_sse, 0x26f598c0);
+#endif
+        run_benchmark_stream(stream, stream_length, N, C*100, " strx ", parse_ip_stream_sse, 0x26f598c0);
+        run_benchmark_stream(stream_big, stream_big_length, N*100, C, " strx+", parse_ip_stream_sse, 0xfa929ccc);
+        run_benchmark_index_parse(stream, stream_length, N, C*100, " idxx ", parse_ip_sse_len, 0x26f598c0);
+        run_benchmark_index_parse(stream_big, stream_big_length, N*100, C, " idxx+", parse_ip_sse_len, 0xfa929ccc);
+        run_benchmark_tight(tight, tight_lengths, N, C*100, " lenx=", parse_ip_sse_len, 0x26f598c0);
+        run_benchmark_cidr(cidrs, N, C*100, " csse ", parse_cidr_sse, 0x4d43b580);
+        run_benchmark_cidr(cidrs, N*100, C, " csse+", parse_cidr_sse, 0xa0be6ae4);
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        run_benchmark_format(N, C*100, " fsse ", NULL, format_ip_batch_sse, 0x26f598c0);
+        run_benchmark_format(N*100, C, " fsse+", NULL, format_ip_batch_sse, 0xfa929ccc);
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        run_benchmark(test, N, C*100, "shape ", parse_ip_shape, 0x26f598c0);
+        run_benchmark(test, N*100, C, "shape+", parse_ip_shape, 0xfa929ccc);
+#if HAVE_MMAP
+        run_benchmark_guard(&guard, N, C*100, GUARD_PAGE, "shape|", parse_ip_shape, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_START, "shape<", parse_ip_shape, 0x26f598c0);
+        run_benchmark_guard(&guard, N, C*100, GUARD_END, "shape>", parse_ip_shape, 0x26f598c0);
+#endif
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        run_benchmark_batch(test, N, C*100, "  ymm ", parse_ip_batch_avx2, 0x26f598c0);
+        run_benchmark_batch(test, N*100, C, "  ymm+", parse_ip_batch_avx2, 0xfa929ccc);
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        run_benchmark_batch(test, N, C*100, "  zmm ", parse_ip_batch_avx512, 0x26f598c0);
+        run_benchmark_batch(test, N*100, C, "  zmm+", parse_ip_batch_avx512, 0xfa929ccc);
+    }
+#endif
 #endif
     printf("\n");
 
@@ -0,0 +1,397 @@
+/*
+    Parsing one big buffer with many threads
+
+ A single thread tops out at a few hundred MB/s, far less than the
+ memory bandwidth of a big server. So this splits the buffer into
+ 256-KB chunks and parses them on several threads at once, with one
+ of the streaming parsers.
+
+ Chunk edges are at multiples of 256-KB, moved forward to the start
+ of the next token, so no address is cut in two. Each chunk works
+ that out for itself, and the neighboring chunk gets the same answer,
+ so the chunks don't have to be found up front.
+
+ Each thread starts with an even share of the chunks, as a range of
+ chunk numbers, and takes chunks from the front of its range. A
+ thread that runs out steals one from the back of another's range.
+ A range is one 64-bit word, updated with compare-and-swap, so taking
+ a chunk is one atomic operation and there are no locks. Stealing
+ evens out the work when some chunks are slower (more addresses, or
+ pages not yet in memory) or some threads get descheduled.
+
+ The threads are a pool, started the first time they're needed and
+ then kept, waiting on a condition variable for the next call. Each
+ call hands them a job and waits for them to finish it, so parsing
+ many small files doesn't mean creating threads for every one.
+
+ The addresses can come out in the same order as the input, or in
+ any order:
+ - ordered: each chunk writes straight into its own part of `out`,
+   sized for the most addresses that could fit in the chunk. When
+   they're all done, the parts are moved down to close the gaps.
+ - unordered: each thread parses into a small buffer of its own,
+   then copies it to the next free space in `out`. There's no final
+   pass, and `out` is filled densely.
+ */
+#define _DEFAULT_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define HAVE_PTHREADS 1
+#endif
+
+typedef size_t (*STREAMER)(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed);
+
+enum {
+    CHUNK_SIZE = 256 * 1024,
+    LOCAL_MAX = 4096,           /* addresses per copy, when unordered */
+};
+
+/*
+ * The chunks a thread still has to do: the next one in the low 32 bits,
+ * and the end in the high 32 bits. Each gets its own cache line.
+ */
+struct worker {
+    _Alignas(64) uint64_t range;
+};
+
+struct job {
+    const char *buf;
+    size_t len;
+    STREAMER streamer;
+    size_t chunks;
+    unsigned threads;
+    struct worker *workers;
+    uint32_t *out;
+    size_t *counts;             /* per chunk, when ordered */
+    int ordered;
+    size_t next_out;            /* when unordered */
+};
+
+/**
+ * The most addresses `parse_ip_parallel()` can write for a buffer of
+ * `len` bytes, and so the size of `out[]`. Each address takes at
+ * least 8 bytes with its separator, and an ordered parse leaves a gap
+ * of up to one address per chunk.
+ */
+size_t
+parse_ip_parallel_max(size_t len) {
+    return len / 8 + len / CHUNK_SIZE + 2;
+}
+
+/**
+ * Moves `offset` forward to the start of a token, unless it's at the
+ * start or end of the buffer, or is already.
+ */
+static size_t
+snap(const char *buf, size_t len, size_t offset) {
+    if (offset >= len)
+        return len;
+    while (offset > 0 && offset < len && (unsigned char)buf[offset - 1] > ' ')
+        offset++;
+    return offset;
+}
+
+/**
+ * Parses buf[start..end), where the byte before `end` is a separator
+ * or `end` is the end of the whole buffer, writing at most `max_out`
+ * addresses and setting `*next` to where it stopped.
+ */
+static size_t
+parse_range(const struct job *job, size_t start, size_t end, uint32_t *out, size_t max_out, size_t *next) {
+    size_t offset = start;
+    size_t n = 0;
+
+    while (offset < end && n < max_out) {
+        size_t consumed;
+        n += job->streamer(job->buf + offset, end - offset, out + n, max_out - n, &consumed);
+        if (consumed == 0)
+            break;
+        offset += consumed;
+    }
+
+    /* At the end of the buffer, the last address needs a separator */
+    if (n < max_out && offset < end && end - offset < 32) {
+        char tail[33];
+        size_t consumed;
+
+        memcpy(tail, job->buf + offset, end - offset);
+        tail[end - offset] = '\n';
+        n += job->streamer(tail, end - offset + 1, out + n, max_out - n, &consumed);
+        offset = end;
+    }
+    *next = offset;
+    return n;
+}
+
+static void
+do_chunk(struct job *job, size_t chunk) {
+    size_t start = snap(job->buf, job->len, chunk * CHUNK_SIZE);
+    size_t end = snap(job->buf, job->len, (chunk + 1) * CHUNK_SIZE);
+    size_t next;
+
+    if (start >= end) {
+        if (job->ordered)
+            job->counts[chunk] = 0;
+        return;
+    }
+
+    if (job->ordered) {
+        /* This chunk's part of `out`, which no other chunk can reach */
+        uint32_t *out = job->out + start / 8 + chunk;
+        job->counts[chunk] = parse_range(job, start, end, out, (end - start) / 8 + 1, &next);
+    } else {
+        uint32_t local[LOCAL_MAX];
+        while (start < end) {
+            size_t n = parse_range(job, start, end, local, LOCAL_MAX, &next);
+            size_t at = __atomic_fetch_add(&job->next_out, n, __ATOMIC_RELAXED);
+            memcpy(job->out + at, local, n * sizeof(local[0]));
+            if (next == start)
+                break;
+            start = next;
+        }
+    }
+}
+
+/**
+ * Takes the next chunk from the front of a thread's own range.
+ * @returns 0 if there are none left
+ */
+static int
+take(struct worker *w, size_t *chunk) {
+    uint64_t range = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        uint64_t lo = range & 0xFFFFFFFF;
+        uint64_t hi = range >> 32;
+        if (lo >= hi)
+            return 0;
+        if (__atomic_compare_exchange_n(&w->range, &range, hi << 32 | (lo + 1), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *chunk = (size_t)lo;
+            return 1;
+        }
+    }
+}
+
+/**
+ * Steals a chunk from the back of another thread's range.
+ * @returns 0 if there are none left anywhere
+ */
+static int
+steal(struct job *job, unsigned self, size_t *chunk) {
+    unsigned i;
+
+    for (i=1; i<job->threads; i++) {
+        struct worker *w = &job->workers[(self + i) % job->threads];
+        uint64_t range = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+
+        for (;;) {
+            uint64_t lo = range & 0xFFFFFFFF;
+            uint64_t hi = range >> 32;
+            if (lo >= hi)
+                break;
+            if (__atomic_compare_exchange_n(&w->range, &range, (hi - 1) << 32 | lo, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                *chunk = (size_t)(hi - 1);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Takes and parses chunks, its own and then stolen ones, until there
+ * are none left. `self` is the thread's number in the job.
+ */
+static void
+run_worker(struct job *job, unsigned self) {
+    size_t chunk;
+
+    for (;;) {
+        if (!take(&job->workers[self], &chunk) && !steal(job, self, &chunk))
+            break;
+        do_chunk(job, chunk);
+    }
+}
+
+#if HAVE_PTHREADS
+/*
+ * The threads, started the first time they're needed and then kept,
+ * waiting for the next job, so a call doesn't pay for creating them.
+ * Pool thread `self` is thread `self` of a job; the caller is 0.
+ */
+static struct {
+    pthread_mutex_t call;       /* one job at a time */
+    pthread_mutex_t lock;
+    pthread_cond_t start;       /* a new job is up */
+    pthread_cond_t done;        /* the last pool thread finished */
+    unsigned count;             /* pool threads started */
+    unsigned long generation;   /* jobs handed out so far */
+    struct job *job;            /* only valid for threads below `threads` */
+    unsigned threads;           /* threads on the job, counting the caller */
+    unsigned busy;              /* pool threads still on the job */
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    0, 0, NULL, 0, 0,
+};
+
+/*
+ * A new pool thread's number, and the last job it's not part of: the
+ * one before it was started, since it may not get to run until after
+ * the next one is handed out.
+ */
+struct pool_arg {
+    unsigned self;
+    unsigned long seen;
+};
+
+static void *
+pool_thread(void *arg) {
+    struct pool_arg *a = arg;
+    unsigned self = a->self;
+    unsigned long seen = a->seen;
+
+    free(a);
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        struct job *job;
+
+        while (pool.generation == seen)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        seen = pool.generation;
+        /* A thread that isn't on the job may only get here after the
+         * caller has returned, so it mustn't look at `pool.job`. */
+        if (self >= pool.threads)
+            continue;
+        job = pool.job;
+
+        pthread_mutex_unlock(&pool.lock);
+        run_worker(job, self);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0)
+            pthread_cond_signal(&pool.done);
+    }
+    return NULL;
+}
+
+/**
+ * Starts pool threads until there are `want` of them.
+ * @returns how many there are, which is fewer if one couldn't start
+ */
+static unsigned
+pool_grow(unsigned want) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.count < want) {
+        struct pool_arg *a = malloc(sizeof(*a));
+        pthread_t tid;
+
+        if (a == NULL)
+            break;
+        a->self = pool.count + 1;
+        a->seen = pool.generation;
+        if (pthread_create(&tid, NULL, pool_thread, a) != 0) {
+            free(a);
+            break;
+        }
+        pthread_detach(tid);
+        pool.count++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return pool.count;
+}
+
+/**
+ * Runs `job` on the caller and `job->threads - 1` pool threads, and
+ * waits for them all.
+ */
+static void
+pool_run(struct job *job) {
+    pthread_mutex_lock(&pool.lock);
+    pool.job = job;
+    pool.threads = job->threads;
+    pool.busy = job->threads - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_worker(job, 0);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy != 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+#endif
+
+/**
+ * Parses all the whitespace-separated addresses in `buf` with
+ * `streamer`, on `threads` threads (counting the calling one).
+ * `out[]` must have room for `parse_ip_parallel_max(len)` addresses.
+ * If `ordered` is set they're in the same order as in `buf`.
+ * Calls from several threads at once take turns.
+ * @returns the number of addresses
+ */
+size_t
+parse_ip_parallel(const char *buf, size_t len, STREAMER streamer, unsigned threads,
+                  int ordered, uint32_t *out) {
+    struct job job;
+    size_t total = 0;
+    size_t i;
+
+    memset(&job, 0, sizeof(job));
+    job.buf = buf;
+    job.len = len;
+    job.streamer = streamer;
+    job.chunks = (len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    job.threads = threads ? threads : 1;
+    job.out = out;
+    job.ordered = ordered;
+    if (job.threads > job.chunks)
+        job.threads = job.chunks ? (unsigned)job.chunks : 1;
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&pool.call);
+    if (job.threads > 1) {
+        unsigned started = pool_grow(job.threads - 1);
+        if (started + 1 < job.threads)
+            job.threads = started + 1;
+    }
+#else
+    job.threads = 1;
+#endif
+    job.workers = aligned_alloc(64, job.threads * sizeof(*job.workers));
+    job.counts = ordered ? malloc((job.chunks + 1) * sizeof(*job.counts)) : NULL;
+
+    /* An even share of the chunks each */
+    for (i=0; i<job.threads; i++) {
+        uint64_t lo = job.chunks * i / job.threads;
+        uint64_t hi = job.chunks * (i + 1) / job.threads;
+        job.workers[i].range = hi << 32 | lo;
+    }
+#if HAVE_PTHREADS
+    pool_run(&job);
+    pthread_mutex_unlock(&pool.call);
+#else
+    run_worker(&job, 0);
+#endif
+
+    if (ordered) {
+        /* Close up the gaps between the chunks' parts of `out` */
+        for (i=0; i<job.chunks; i++) {
+            size_t start = snap(buf, len, i * CHUNK_SIZE);
+            memmove(out + total, out + start / 8 + i, job.counts[i] * sizeof(*out));
+            total += job.counts[i];
+        }
+    } else
+        total = job.next_out;
+
+    free(job.counts);
+    free(job.workers);
+    return total;
+}
@@ -0,0 +1,280 @@
+/*
+    Parse CIDR blocks and ranges of IPv4 addresses
+
+ Target and exclude lists are mostly subnets, not single addresses.
+ These parse the three forms such lists use, and return the range of
+ addresses each covers as `[first, last]`:
+
+    10.1.2.3                  [10.1.2.3, 10.1.2.3]
+    10.0.0.0/8                [10.0.0.0, 10.255.255.255]
+    10.0.0.1-10.0.0.99        [10.0.0.1, 10.0.0.99]
+
+ A CIDR block with host bits set, like `10.1.2.3/8`, is taken to mean
+ the whole block, as most tools do. A prefix is 0 to 32, with no
+ leading zeroes, and a range must not run backwards. Like the address
+ parsers, each entry must be followed by a space or nul, or the end of
+ the buffer. They return the bytes consumed, not counting that.
+
+ There are three versions, in the styles of the address parsers:
+
+ - `parse_cidr_fsm()`: a byte at a time, with a state machine.
+ - `parse_cidr_swar()`: loads the entry's 32 bytes as four 64-bit
+   words, and makes a 32-bit mask of the bytes that aren't digits or
+   dots. The first one is the `/`, `-`, or terminator after the first
+   address, and the next is the end of the entry, so one mask gives
+   the whole layout. The addresses, their lengths now known, go to
+   `parse_ip_swar2_len()`.
+ - `parse_cidr_sse()`: the same, with the mask from two SSE
+   compares, and the addresses going to `parse_ip_sse_len()`.
+
+ The longest entry, `255.255.255.255-255.255.255.255`, is 31 bytes, so
+ with its terminator it fits in the 32 bytes. Near the end of the
+ buffer, the bytes are copied out first.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+size_t parse_ip_swar2_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_ip_sse_len(const char *buf, size_t length, uint32_t *out);
+
+/**
+ * Turns an address and prefix length into the block's range. The
+ * shift is done in 64 bits so that a prefix of 0 works.
+ */
+static inline void
+cidr_range(uint32_t address, uint32_t prefix, uint32_t *first, uint32_t *last) {
+    uint32_t mask = (uint32_t)(~0ULL << (32 - prefix));
+    *first = address & mask;
+    *last = address | ~mask;
+}
+
+static inline int
+is_term(unsigned c) {
+    return c == ' ' || c == '\0';
+}
+
+/*
+ * ---- fsm ----
+ */
+
+size_t
+parse_cidr_fsm(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last) {
+    enum {
+        OCTET_START,        /* need a digit */
+        OCTET,              /* in an octet: digit, '.', or what comes after */
+        PREFIX_START,
+        PREFIX,
+    } state = OCTET_START;
+    uint32_t addresses[2] = {0, 0};
+    unsigned which = 0;     /* the address being parsed */
+    unsigned octets = 0;    /* octets done in it */
+    unsigned value = 0;
+    unsigned digits = 0;
+    size_t i;
+
+    for (i=0; i<maxlen && !is_term((unsigned char)buf[i]); i++) {
+        unsigned c = (unsigned char)buf[i];
+
+        switch (state) {
+        case OCTET_START:
+        case PREFIX_START:
+            if (c - '0' > 9)
+                return 0;
+            value = c - '0';
+            digits = 1;
+            state = state == OCTET_START ? OCTET : PREFIX;
+            break;
+        case OCTET:
+            if (c - '0' <= 9) {
+                if (value == 0 || ++digits > 3)
+                    return 0;
+                value = value * 10 + (c - '0');
+                if (value > 255)
+                    return 0;
+            } else if (c == '.' && octets < 3) {
+                addresses[which] = addresses[which] << 8 | value;
+                octets++;
+                state = OCTET_START;
+            } else if ((c == '/' || c == '-') && octets == 3 && which == 0) {
+                addresses[0] = addresses[0] << 8 | value;
+                octets = 0;
+                which = 1;
+                state = c == '/' ? PREFIX_START : OCTET_START;
+            } else
+                return 0;
+            break;
+        case PREFIX:
+            if (c - '0' > 9 || value == 0 || ++digits > 2)
+                return 0;
+            value = value * 10 + (c - '0');
+            break;
+        }
+    }
+
+    /* What's allowed to be followed by the terminator */
+    if (state == PREFIX) {
+        if (value > 32)
+            return 0;
+        cidr_range(addresses[0], value, first, last);
+    } else if (state == OCTET && octets == 3) {
+        addresses[which] = addresses[which] << 8 | value;
+        if (which == 0)
+            addresses[1] = addresses[0];
+        else if (addresses[0] > addresses[1])
+            return 0;
+        *first = addresses[0];
+        *last = addresses[1];
+    } else
+        return 0;
+    return i;
+}
+
+/*
+ * ---- The layout, shared by swar and sse ----
+ */
+
+/**
+ * Parses the prefix length, 1 or 2 digits in p[0..length).
+ * @returns it, or 33 on error
+ */
+static inline uint32_t
+parse_prefix(const char *p, size_t length) {
+    uint32_t d0 = (uint32_t)(unsigned char)p[0] - '0';
+    uint32_t d1 = (uint32_t)(unsigned char)p[length > 1] - '0';
+    uint32_t value = length > 1 ? d0 * 10 + d1 : d0;
+
+    if (length - 1 > 1 || d0 > 9 || d1 > 9 || (length > 1 && d0 == 0) || value > 32)
+        return 33;
+    return value;
+}
+
+/**
+ * Parses an entry whose layout is known: `split` is the index of the
+ * first byte that isn't a digit or dot, and `end` the next one after
+ * that, or 32 if there isn't one. `parse_len` parses an address of
+ * known length; it may read 16 bytes, so p[] must have 48 readable.
+ */
+static inline size_t
+parse_layout(const char *p, uint32_t split, uint32_t end, uint32_t *first, uint32_t *last,
+             size_t (*parse_len)(const char *, size_t, uint32_t *)) {
+    unsigned c = (unsigned char)p[split];
+    uint32_t a, b;
+
+    if (parse_len(p, split, &a) == 0)
+        return 0;
+    if (is_term(c)) {
+        *first = *last = a;
+        return split;
+    }
+    if (end >= 32 || !is_term((unsigned char)p[end]))
+        return 0;
+    if (c == '/') {
+        uint32_t prefix = parse_prefix(p + split + 1, end - split - 1);
+        if (prefix > 32)
+            return 0;
+        cidr_range(a, prefix, first, last);
+        return end;
+    }
+    if (c == '-' && parse_len(p + split + 1, end - split - 1, &b) != 0 && a <= b) {
+        *first = a;
+        *last = b;
+        return end;
+    }
+    return 0;
+}
+
+/*
+ * ---- swar ----
+ */
+
+#define ONES  0x0101010101010101ULL
+#define LOWS  0x7F7F7F7F7F7F7F7FULL
+#define HIGHS 0x8080808080808080ULL
+
+static inline uint64_t
+load64(const char *p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+/**
+ * A bit for each of the 8 bytes that isn't a digit or a dot. The
+ * same tricks as `parse-ip-swar2.c`.
+ */
+static inline uint32_t
+other_bits(uint64_t x) {
+    uint64_t y = x ^ (ONES * '0');
+    uint64_t digit = ~(((y & LOWS) + ONES * (0x80 - 10)) | y) & HIGHS;
+    uint64_t d = x ^ (ONES * '.');
+    uint64_t dot = ~(((d & LOWS) + LOWS) | d | LOWS);
+    uint64_t other = ~(digit | dot) & HIGHS;
+    return (uint32_t)(((other >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+size_t
+parse_cidr_swar(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last) {
+    char tmp[48];
+    const char *p = buf;
+    uint32_t others, split, end;
+
+    if (maxlen < 48) {
+        /* Near the end of the buffer, which terminates the entry */
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, buf, maxlen < 32 ? maxlen : 32);
+        p = tmp;
+    }
+    others = other_bits(load64(p)) | other_bits(load64(p + 8)) << 8
+           | other_bits(load64(p + 16)) << 16 | other_bits(load64(p + 24)) << 24;
+    if (others == 0)
+        return 0;
+    split = (uint32_t)__builtin_ctz(others);
+    others &= others - 1;
+    end = others ? (uint32_t)__builtin_ctz(others) : 32;
+    return parse_layout(p, split, end, first, last, parse_ip_swar2_len);
+}
+
+/*
+ * ---- sse ----
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSE41 __attribute__((target("sse4.1,popcnt")))
+
+SSE41 static inline uint32_t
+other_mask(__m128i v) {
+    __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    __m128i is_dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+    return (uint32_t)(uint16_t)~_mm_movemask_epi8(_mm_or_si128(is_digit, is_dot));
+}
+
+SSE41 size_t
+parse_cidr_sse(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last) {
+    char tmp[48];
+    const char *p = buf;
+    uint32_t others, split, end;
+
+    if (maxlen < 48) {
+        memset(tmp, 0, sizeof(tmp));
+        memcpy(tmp, buf, maxlen < 32 ? maxlen : 32);
+        p = tmp;
+    }
+    others = other_mask(_mm_loadu_si128((const __m128i *)p))
+           | other_mask(_mm_loadu_si128((const __m128i *)(p + 16))) << 16;
+    if (others == 0)
+        return 0;
+    split = (uint32_t)__builtin_ctz(others);
+    others &= others - 1;
+    end = others ? (uint32_t)__builtin_ctz(others) : 32;
+    return parse_layout(p, split, end, first, last, parse_ip_sse_len);
+}
+#else
+size_t
+parse_cidr_sse(const char *buf, size_t maxlen, uint32_t *first, uint32_t *last) {
+    (void)buf; (void)maxlen; (void)first; (void)last;
+    return 0;
+}
+#endif
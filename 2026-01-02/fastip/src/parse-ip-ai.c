@@ -9,6 +9,7 @@
 #include <stdint.h>
 
 size_t parse_ip_ai(const char *p, size_t length, unsigned *out) {
+    const char *start = p;
     const char *pend = p + length;
     uint32_t ip = 0;
     int octets = 0;
@@ -42,7 +43,7 @@ size_t parse_ip_ai(const char *p, size_t length, unsigned *out) {
     }
     if (octets == 4) {
         *out = ip;
-        return 1;
+        return (size_t)(p - start); // bytes consumed, like the other parsers
     } else {
         return 0;
     }
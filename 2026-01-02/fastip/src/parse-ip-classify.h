@@ -0,0 +1,89 @@
+#ifndef PARSE_IP_CLASSIFY_H
+#define PARSE_IP_CLASSIFY_H
+
+/*
+ * Classifies 64 bytes of text at a time into bit masks, bit `i` for
+ * byte `i`, for the structural passes in `parse-ip-index.c` and
+ * `parse-ip-extract.c`. Each uses only some of the masks, and the
+ * compiler drops the work for the rest once this is inlined.
+ */
+#include <stdint.h>
+
+/* It has to be inlined for the unused masks to be dropped, and it's
+ * too big for GCC to do that on its own. */
+#define CLASSIFY_INLINE static inline __attribute__((always_inline))
+
+struct byte_masks {
+    uint64_t seps;      /* any byte <= ' ' */
+    uint64_t digits;    /* '0'..'9' */
+    uint64_t dots;      /* '.' */
+    uint64_t word;      /* letters, digits, '.', '_' */
+};
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+static inline uint64_t
+movemask64(__m128i a, __m128i b, __m128i c, __m128i d) {
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(a)
+         | (uint64_t)(uint16_t)_mm_movemask_epi8(b) << 16
+         | (uint64_t)(uint16_t)_mm_movemask_epi8(c) << 32
+         | (uint64_t)(uint16_t)_mm_movemask_epi8(d) << 48;
+}
+
+/**
+ * Classifies 64 bytes. This only needs SSE2, so every x86-64 has it.
+ * `x - lo <= n` as unsigned bytes is a range check, done as
+ * `min(x - lo, n) == x - lo`.
+ */
+CLASSIFY_INLINE struct byte_masks
+classify64(const char *p) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i lower_a = _mm_set1_epi8('a');
+    const __m128i z = _mm_set1_epi8(25);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i underscore = _mm_set1_epi8('_');
+    __m128i s[4], g[4], d[4], w[4];
+    struct byte_masks m;
+    int k;
+
+    for (k=0; k<4; k++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16*k));
+        __m128i digit = _mm_sub_epi8(v, zero);
+        __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, case_bit), lower_a);
+        s[k] = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+        g[k] = _mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit);
+        d[k] = _mm_cmpeq_epi8(v, dot);
+        alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, z), alpha);
+        w[k] = _mm_or_si128(_mm_or_si128(g[k], alpha),
+                            _mm_or_si128(d[k], _mm_cmpeq_epi8(v, underscore)));
+    }
+    m.seps = movemask64(s[0], s[1], s[2], s[3]);
+    m.digits = movemask64(g[0], g[1], g[2], g[3]);
+    m.dots = movemask64(d[0], d[1], d[2], d[3]);
+    m.word = movemask64(w[0], w[1], w[2], w[3]);
+    return m;
+}
+#else
+CLASSIFY_INLINE struct byte_masks
+classify64(const char *p) {
+    struct byte_masks m = {0, 0, 0, 0};
+    int i;
+
+    for (i=0; i<64; i++) {
+        unsigned c = (unsigned char)p[i];
+        unsigned digit = c - '0' <= 9;
+        unsigned alpha = (c | 0x20) - 'a' <= 25;
+        m.seps |= (uint64_t)(c <= ' ') << i;
+        m.digits |= (uint64_t)digit << i;
+        m.dots |= (uint64_t)(c == '.') << i;
+        m.word |= (uint64_t)(digit | alpha | (c == '.') | (c == '_')) << i;
+    }
+    return m;
+}
+#endif
+
+#endif
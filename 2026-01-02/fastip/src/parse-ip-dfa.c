@@ -3,8 +3,29 @@
  
     This is sort of what you'd get from using a `regex` with
     `capture groups` to parse an IPv4 address.
+
+    There are two versions. The first uses a big `int` table indexed
+    by state and byte, which is 100-KB. The second, `compact`, first
+    maps each byte to an equivalence class (digit, dot, terminator,
+    or other) and then uses a tiny `uint8_t` table indexed by state
+    and class, which fits in a couple of cache lines. That one also
+    folds the `indexes[]` lookup into the table entries.
+
+    The `pair` version goes further and consumes two bytes per
+    transition. Its alphabet is pairs of byte classes (4*4 = 16),
+    so the table is still tiny, but an address takes half as many
+    dependent steps.
+
+    Finally, `batch` runs several addresses through the big table in
+    lock-step. Each step of a DFA has to wait for the previous table
+    lookup, so a single address keeps the CPU mostly idle. With
+    several independent addresses in one loop, their lookups overlap.
  */
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 enum {
     START=0,
@@ -13,12 +34,100 @@ enum {
     NUM3_1, NUM3_2, NUM3_3, DOT3,
     NUM4_1, NUM4_2, NUM4_3,
     DONE,
-    ERROR
+    ERROR,
+    DONE_MID /* stride-2 only: DONE on the first byte of the pair */
 };
 
 static int table[100][256];
 static int indexes[] = {0, 1, 1, 1, 0, 2, 2, 2, 0, 3, 3, 3, 0, 4, 4, 4, 0, 0};
 
+/*
+ * The compact tables. Each entry in `compact` holds the next state
+ * in the low 5 bits, and that state's `indexes[]` in the top 3 bits.
+ */
+#define MAX_CLASSES 4 /* digit, dot, terminator, other */
+static uint8_t classes[256];
+static uint8_t compact[ERROR+1][MAX_CLASSES];
+static unsigned class_count;
+
+/**
+ * Builds the compact tables from the big one. Two bytes are in the
+ * same class if they have the same column in the big table, meaning
+ * every state treats them the same.
+ */
+static void compact_init(void) {
+    unsigned representative[MAX_CLASSES];
+    int c;
+    int i;
+
+    class_count = 0;
+    for (c=0; c<256; c++) {
+        unsigned k;
+        for (k=0; k<class_count; k++) {
+            for (i=0; i<=ERROR; i++) {
+                if (table[i][c] != table[i][representative[k]])
+                    break;
+            }
+            if (i > ERROR)
+                break;
+        }
+        if (k == class_count) {
+            if (class_count == MAX_CLASSES) {
+                fprintf(stderr, "[-] dfa: too many byte classes\n");
+                abort();
+            }
+            representative[class_count++] = (unsigned)c;
+        }
+        classes[c] = (uint8_t)k;
+    }
+
+    memset(compact, ERROR, sizeof(compact));
+    for (i=0; i<=ERROR; i++) {
+        unsigned k;
+        for (k=0; k<class_count; k++) {
+            int next = table[i][representative[k]];
+            compact[i][k] = (uint8_t)(next | indexes[next] << 5);
+        }
+    }
+}
+
+/*
+ * For the stride-2 version, what each state means for the values:
+ * KIND_NUM states add a digit to the current octet, KIND_COMMIT
+ * states (the dots and DONE) mean the octet just finished.
+ */
+enum {KIND_NUM = 1, KIND_COMMIT = 2};
+static const unsigned char kinds[] = {0, 1, 1, 1, 2, 1, 1, 1, 2,
+                                      1, 1, 1, 2, 1, 1, 1, 2, 0, 0};
+
+/*
+ * The stride-2 table, indexed by state and a pair of byte classes.
+ * Each entry holds the state after both bytes in the low 5 bits, and
+ * the `kinds[]` of the state after the first byte above that.
+ */
+static uint8_t pairs[DONE_MID+1][MAX_CLASSES*MAX_CLASSES];
+
+/**
+ * Builds the stride-2 table by running the compact table twice.
+ */
+static void pairs_init(void) {
+    unsigned i;
+
+    memset(pairs, ERROR, sizeof(pairs));
+    for (i=0; i<=ERROR; i++) {
+        unsigned a, b;
+        for (a=0; a<class_count; a++) {
+            for (b=0; b<class_count; b++) {
+                unsigned mid = compact[i][a] & 0x1F;
+                unsigned next = compact[mid][b] & 0x1F;
+                if (mid == DONE)
+                    next = DONE_MID;
+                pairs[i][a*MAX_CLASSES + b] = (uint8_t)(next | kinds[mid] << 5);
+            }
+        }
+    }
+}
+
 void parse_ip_dfa_init(void) {
     int c;
     int i;
@@ -65,6 +174,32 @@ void parse_ip_dfa_init(void) {
         table[NUM4_2][c] = DONE;
         table[NUM4_1][c] = DONE;
     }
+
+    /* Once DONE, stay DONE. The single-address parsers stop at DONE
+     * and never read this row, but the batch version keeps stepping
+     * lanes that finished early. */
+    for (c=0; c<256; c++)
+        table[DONE][c] = DONE;
+
+    compact_init();
+    pairs_init();
+}
+
+/**
+ * For the code generator in `dfagen.c`, which turns the table into
+ * straight-line code: the state after `c`, and which of `nums[]` that
+ * state adds its digit to (0 means none).
+ */
+int parse_ip_dfa_next(int state, unsigned c) {
+    return table[state][c & 0xFF];
+}
+int parse_ip_dfa_octet(int state) {
+    return indexes[state];
+}
+void parse_ip_dfa_special(int *start, int *done, int *error) {
+    *start = START;
+    *done = DONE;
+    *error = ERROR;
 }
 
 size_t parse_ip_dfa(const char *buf, size_t length, unsigned *ip_address) {
@@ -85,5 +220,203 @@ size_t parse_ip_dfa(const char *buf, size_t length, unsigned *ip_address) {
     
     *ip_address = nums[1]<<24 | nums[2]<<16 | nums[3]<<8 | nums[4];
     
-    return offset;
+    return offset - (state == DONE); /* not counting the terminator */
+}
+
+size_t parse_ip_dfa_compact(const char *buf, size_t length, unsigned *ip_address) {
+    size_t offset = 0;
+    unsigned state = 0;
+    unsigned short nums[5] = {0, 0, 0, 0, 0};
+    int is_error;
+
+    while ((length - offset) && (DONE - state)) {
+        unsigned c = (unsigned char)buf[offset++];
+        unsigned next = compact[state][classes[c]];
+        state = next & 0x1F;
+        nums[next >> 5] *= 10;
+        nums[next >> 5] += c - '0';
+    }
+    is_error = (nums[1]>255) + (nums[2]>255) + (nums[3]>255) + (nums[4]>255);
+    if (is_error || state == ERROR)
+        return 0;
+
+    *ip_address = nums[1]<<24 | nums[2]<<16 | nums[3]<<8 | nums[4];
+
+    return offset - (state == DONE);
+}
+
+/**
+ * Parses a token of exactly `length` bytes with the compact tables,
+ * for `parse-ip-stream.c`, which has already found where it ends.
+ * It's only an address if all of it gets the DFA to the last octet.
+ * Unlike `parse_ip_dfa()`, this rejects leading zeroes, like the
+ * other streamers' parsers do.
+ * Returns `length` if it's a valid address, else 0.
+ */
+size_t parse_ip_dfa_len(const char *buf, size_t length, uint32_t *out) {
+    unsigned state = START;
+    unsigned short nums[5] = {0, 0, 0, 0, 0};
+    unsigned zero = 0;      /* the last byte was a '0' starting an octet */
+    unsigned leading = 0;   /* ...and another digit followed it */
+    size_t offset;
+
+    if (length - 7 > 8)
+        return 0;
+    for (offset=0; offset<length; offset++) {
+        unsigned c = (unsigned char)buf[offset];
+        unsigned next = compact[state][classes[c]];
+        state = next & 0x1F;
+        nums[next >> 5] = (unsigned short)(nums[next >> 5] * 10 + (c - '0'));
+        leading |= zero & (c - '0' <= 9);
+        zero = (c == '0') & ((state & 3) == 1);  /* NUM1_1, NUM2_1, ... */
+    }
+    if (state - NUM4_1 > NUM4_3 - NUM4_1 || leading)
+        return 0;
+    if ((nums[1]>255) + (nums[2]>255) + (nums[3]>255) + (nums[4]>255))
+        return 0;
+
+    *out = (uint32_t)nums[1]<<24 | nums[2]<<16 | nums[3]<<8 | nums[4];
+    return length;
+}
+
+/*
+ * Number of addresses run through the DFA together.
+ */
+#define LANES 8
+
+/*
+ * In the batch version, each lane's `nums[]` are packed as 12-bit
+ * fields into one 64-bit integer so they stay in registers. This
+ * is the shift for each state's field, the same as `indexes[]`,
+ * with the throw-away field on top, where its overflow falls off
+ * the end.
+ */
+static const unsigned char shifts[] = {48, 36, 36, 36, 48, 24, 24, 24, 48,
+                                       12, 12, 12, 48,  0,  0,  0, 48, 48};
+
+/**
+ * Parses `count` addresses on a 16-byte stride, LANES at a time.
+ * Invalid addresses are written as 0. Returns the number of valid
+ * addresses.
+ */
+size_t parse_ip_dfa_batch(const char *buf, size_t count, uint32_t *out) {
+    size_t valid = 0;
+    size_t i;
+
+    for (i=0; i + LANES <= count; i += LANES) {
+        const char *p = buf + i*16;
+        unsigned state[LANES];
+        uint64_t nums[LANES];
+        size_t offset;
+        int k;
+
+        for (k=0; k<LANES; k++) {
+            state[k] = START;
+            nums[k] = 0;
+        }
+
+        /* One byte of every lane per step. Lanes that finished early
+         * stay DONE or ERROR. */
+        for (offset=0; offset<16; offset++) {
+            unsigned active = 0;
+            for (k=0; k<LANES; k++) {
+                unsigned c = (unsigned char)p[k*16 + offset];
+                unsigned shift;
+                state[k] = (unsigned)table[state[k]][c];
+                shift = shifts[state[k]];
+                /* nums[index] = nums[index]*10 + digit */
+                nums[k] += (((nums[k] >> shift) & 0xFFF) * 9 + (c - '0')) << shift;
+                active |= (state[k] < DONE);
+            }
+            if (!active)
+                break;
+        }
+
+        for (k=0; k<LANES; k++) {
+            unsigned n1 = (nums[k] >> 36) & 0xFFF;
+            unsigned n2 = (nums[k] >> 24) & 0xFFF;
+            unsigned n3 = (nums[k] >> 12) & 0xFFF;
+            unsigned n4 = (nums[k] >>  0) & 0xFFF;
+            int is_error = (n1>255) + (n2>255) + (n3>255) + (n4>255) + (state[k] != DONE);
+            out[i+k] = is_error ? 0 : (n1<<24 | n2<<16 | n3<<8 | n4);
+            valid += !is_error;
+        }
+    }
+
+    /* Leftovers, one at a time */
+    for (; i<count; i++) {
+        out[i] = 0;
+        valid += parse_ip_dfa(buf + i*16, 16, &out[i]) != 0;
+    }
+    return valid;
+}
+
+/*
+ * For the stride-2 version, how many octets have been finished by
+ * the time we reach each state.
+ */
+static const unsigned char finished[] = {0, 0, 0, 0, 1, 1, 1, 1, 2,
+                                         2, 2, 2, 3, 3, 3, 3, 4, 0, 4};
+
+/**
+ * Updates the octet value `val` and the finished octets in `ip` for
+ * one byte, given the kind of state that byte led to. The octets are
+ * 16-bit fields in `ip`, so that values over 255 can be checked at
+ * the end instead of on every byte.
+ */
+static inline void
+pair_accumulate(unsigned kind, unsigned c, uint64_t *ip, unsigned *val) {
+    unsigned commit = kind >> 1;
+    unsigned num_mask = 0u - (kind & KIND_NUM);
+    *ip = (*ip << (16 * commit)) | (*val & (0u - commit));
+    /* Masks rather than `?:`, which compiles to a branch that the
+     * CPU can't predict */
+    *val = ((*val * 10 + (c - '0')) & num_mask) | (*val & ~num_mask & (commit - 1));
+}
+
+size_t parse_ip_dfa_pair(const char *buf, size_t length, unsigned *ip_address) {
+    size_t offset = 0;
+    unsigned state = START;
+    uint64_t ip = 0;
+    unsigned val = 0;
+    unsigned octets;
+
+    /* The state chain only goes through `pairs`. The values are
+     * updated from the two bytes off to the side. */
+    while (length - offset >= 2 && state < DONE) {
+        unsigned c1 = (unsigned char)buf[offset];
+        unsigned c2 = (unsigned char)buf[offset + 1];
+        unsigned entry = pairs[state][classes[c1]*MAX_CLASSES + classes[c2]];
+        state = entry & 0x1F;
+        pair_accumulate(entry >> 5, c1, &ip, &val);
+        pair_accumulate(kinds[state], c2, &ip, &val);
+        offset += 2;
+    }
+
+    /* An odd byte left over at the end of the buffer */
+    if (length - offset == 1 && state < DONE) {
+        unsigned c = (unsigned char)buf[offset++];
+        state = compact[state][classes[c]] & 0x1F;
+        pair_accumulate(kinds[state], c, &ip, &val);
+    }
+
+    if (state == DONE_MID) {
+        state = DONE;
+        offset--;
+    }
+    if (state == ERROR)
+        return 0;
+
+    /* Like `parse_ip_dfa()`, running out of buffer part way through
+     * isn't an error: missing octets are zero */
+    octets = finished[state];
+    if (octets < 4)
+        ip = ((ip << 16) | val) << (16 * (3 - octets));
+
+    if (ip & 0xFF00FF00FF00FF00ULL)
+        return 0;
+
+    *ip_address = (unsigned)((ip >> 24) & 0xFF000000) | (unsigned)((ip >> 16) & 0x00FF0000)
+                | (unsigned)((ip >> 8) & 0x0000FF00) | (unsigned)(ip & 0xFF);
+    return offset - (state == DONE);
 }
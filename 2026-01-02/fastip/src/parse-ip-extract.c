@@ -0,0 +1,139 @@
+/*
+    Find addresses anywhere in free-form text, like log lines
+
+ The other parsers want addresses separated by whitespace. Logs have
+ them anywhere: `from 1.2.3.4 port 22`, `SRC=1.2.3.4`, `[1.2.3.4]:80`.
+ They also have lots of things that look like addresses but aren't,
+ such as versions (`Chrome/120.0.6099.109`, `1.2.3.4.5`) and names
+ (`v10.0.0.1`). This finds the same addresses that `grep -ow` would
+ with a strict address pattern: a run of digits and dots that's a
+ valid address on its own, and isn't part of a longer word.
+
+ The rules are:
+ - the byte before an address isn't a letter, digit, dot, or `_`;
+ - the byte after it isn't a letter, digit, or `_`, and isn't a dot
+   followed by more digits (`1.2.3.4.5`), though a dot at the end of
+   a sentence is fine;
+ - the address itself is checked by a strict parser: exactly four
+   octets, each 0-255, with no leading zeroes.
+
+ Most bytes in a log can't start an address, so the text is first
+ classified 64 bytes at a time, by the same `classify64()` that
+ `parse-ip-index.c` uses, into a mask of digits and a mask of "word"
+ bytes (letters, digits, dots, `_`). A digit whose previous byte
+ isn't a word byte is a candidate, so `digits & ~(word << 1)` gives
+ all of a block's candidates at once, and the loop jumps between
+ them with `ctz()`. Each candidate's run of digits and dots is measured, up to
+ the first dot that isn't followed by a digit, and if it's the right
+ length, handed to `parse_ip_swar2_len()`, the SWAR parser for a
+ token of known length.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse-ip-classify.h"
+
+size_t parse_ip_swar2_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_ip_scalar_len(const char *buf, size_t length, uint32_t *out);
+
+static inline int
+is_digit(unsigned c) {
+    return c - '0' <= 9;
+}
+
+static inline int
+is_word(unsigned c) {
+    return c - '0' <= 9 || (c | 0x20) - 'a' <= 25 || c == '.' || c == '_';
+}
+
+/**
+ * Finds the addresses in `buf`, writing their values to `out[]` and,
+ * if it isn't NULL, where each starts to `offsets[]`. Stops after
+ * `max` of them, setting `*consumed` to where to carry on from, or
+ * to `len` if it got to the end. The start and end of the buffer
+ * count as boundaries.
+ * @returns the number of addresses found
+ */
+size_t
+parse_ip_extract(const char *buf, size_t len, uint32_t *out, size_t *offsets, size_t max, size_t *consumed) {
+    uint64_t prev_word = 0;    /* was the last byte of the last block a word byte? */
+    size_t n = 0;
+    size_t offset;
+
+    for (offset=0; offset<len; offset += 64) {
+        struct byte_masks m;
+        uint64_t starts;
+
+        if (len - offset >= 64)
+            m = classify64(buf + offset);
+        else {
+            /* Pad the last block with non-word bytes */
+            char tmp[64];
+            memset(tmp, ' ', sizeof(tmp));
+            memcpy(tmp, buf + offset, len - offset);
+            m = classify64(tmp);
+        }
+        starts = m.digits & ~(m.word << 1 | prev_word);
+        prev_word = m.word >> 63;
+
+        while (starts) {
+            size_t start = offset + (size_t)__builtin_ctzll(starts);
+            size_t end = start;
+            size_t length;
+            uint32_t result;
+
+            starts &= starts - 1;
+
+            /* The run of digits, and dots followed by digits, but not
+             * one too long to be an address. Dots after it, like the
+             * end of a sentence or an ellipsis, aren't part of it. */
+            while (end < len && end - start <= 16) {
+                unsigned c = (unsigned char)buf[end];
+                if (is_digit(c))
+                    end++;
+                else if (c == '.' && end + 1 < len && is_digit((unsigned char)buf[end + 1]))
+                    end++;
+                else
+                    break;
+            }
+            length = end - start;
+            if (length - 7 > 8)
+                continue;
+            if (end < len && buf[end] != '.' && is_word((unsigned char)buf[end]))
+                continue;       /* part of a longer word */
+
+            if (start + 16 <= len) {
+                if (parse_ip_swar2_len(buf + start, length, &result) == 0)
+                    continue;
+            } else if (parse_ip_scalar_len(buf + start, length, &result) == 0)
+                continue;
+
+            if (n == max) {
+                *consumed = start;
+                return n;
+            }
+            out[n] = result;
+            if (offsets)
+                offsets[n] = start;
+            n++;
+        }
+    }
+    *consumed = len;
+    return n;
+}
+
+/**
+ * `parse_ip_extract()` as a streamer, for the `--file` options and
+ * `ingest.c`. A word cut off at the end of the buffer might be an
+ * address that continues in the next one, so that's left for the
+ * next call.
+ */
+size_t
+parse_ip_stream_extract(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed) {
+    size_t limit = len;
+
+    while (limit > 0 && is_word((unsigned char)buf[limit - 1]))
+        limit--;
+    return parse_ip_extract(buf, limit, out, NULL, max_out, consumed);
+}
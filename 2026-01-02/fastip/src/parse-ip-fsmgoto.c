@@ -0,0 +1,97 @@
+/*
+    State machine parser using "computed goto"
+
+ This is the same state machine as `fsm2`, but instead of one loop
+ with a `switch (state)`, each state is a label, and each state
+ jumps straight to the next one with GCC's `goto *ptr` extension.
+
+ The point is the branch predictor. A `switch` compiles to a single
+ indirect jump that every byte of every address goes through, so
+ the CPU has one branch to predict all the transitions with. Here,
+ each state ends with its own indirect jump, indexed by the class
+ of the next byte (digit, dot, terminator, other). That's the trick
+ interpreters use to run faster: each jump only has to predict what
+ follows *that* state, which is much more regular.
+
+ It needs GCC or clang. The `-Wpedantic` warnings about labels as
+ values are turned off for this file.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+size_t parse_ip_fsm2(const char *buf, size_t len, uint32_t *out);
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+enum {OTHER, DIGIT, DOT, TERM};
+
+static const unsigned char char_class[256] = {
+    [0] = TERM,
+    [' '] = TERM,
+    ['.'] = DOT,
+    ['0' ... '9'] = DIGIT,
+};
+
+/*
+ * Fetches the next byte and jumps to one of four labels depending on
+ * its class. Every use is a separate indirect jump.
+ */
+#define DISPATCH(other, digit, dot, term) do { \
+        static const void *const targets[] = {other, digit, dot, term}; \
+        if (i >= len) \
+            return 0; \
+        c = (unsigned char)buf[i++]; \
+        goto *targets[char_class[c]]; \
+    } while (0)
+
+/*
+ * The three digit states of an octet, ended by a dot or terminator.
+ */
+#define OCTET(k, dot, term) \
+    num##k##_1: \
+        value = c - '0'; \
+        DISPATCH(&&error, &&num##k##_2, dot, term); \
+    num##k##_2: \
+        if (value == 0) \
+            return 0; /* no leading zeroes */ \
+        value = value * 10 + (c - '0'); \
+        DISPATCH(&&error, &&num##k##_3, dot, term); \
+    num##k##_3: \
+        value = value * 10 + (c - '0'); \
+        DISPATCH(&&error, &&error, dot, term)
+
+size_t parse_ip_fsm_goto(const char *buf, size_t len, uint32_t *out)
+{
+    uint32_t ip_address = 0;
+    unsigned value = 0;
+    unsigned c;
+    size_t i = 0;
+
+    DISPATCH(&&error, &&num1_1, &&error, &&error);
+    OCTET(1, &&dot1, &&error);
+dot1:
+    ip_address = ip_address<<8 | value;
+    DISPATCH(&&error, &&num2_1, &&error, &&error);
+    OCTET(2, &&dot2, &&error);
+dot2:
+    ip_address = ip_address<<8 | value;
+    DISPATCH(&&error, &&num3_1, &&error, &&error);
+    OCTET(3, &&dot3, &&error);
+dot3:
+    ip_address = ip_address<<8 | value;
+    DISPATCH(&&error, &&num4_1, &&error, &&error);
+    OCTET(4, &&error, &&done);
+done:
+    *out = ip_address<<8 | value;
+    return i - 1;   /* bytes consumed (terminator not consumed) */
+error:
+    return 0;
+}
+
+#else
+size_t parse_ip_fsm_goto(const char *buf, size_t len, uint32_t *out)
+{
+    return parse_ip_fsm2(buf, len, out);
+}
+#endif
@@ -0,0 +1,130 @@
+/*
+    State machine parser using tail calls
+
+ This is the same state machine as `fsm2` and `fsmgoto`, but each
+ state is its own function, which ends by calling the function for
+ the next state. The call is picked from a small table by the class
+ of the next byte, so like `fsmgoto`, every state has its own
+ indirect branch.
+
+ This only works if the calls become jumps, otherwise the stack
+ grows by a frame per byte. Clang (and GCC 15) have `musttail` to
+ guarantee that; older GCC doesn't, but does it anyway at `-O2`
+ since all the states have the same signature. All the parser
+ state is passed in the arguments, so it lives in registers.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+size_t parse_ip_fsm2(const char *buf, size_t len, uint32_t *out);
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define MUSTTAIL __attribute__((musttail))
+#endif
+#endif
+#ifndef MUSTTAIL
+#define MUSTTAIL
+#endif
+
+enum {OTHER, DIGIT, DOT, TERM};
+
+static const unsigned char char_class[256] = {
+    [0] = TERM,
+    [' '] = TERM,
+    ['.'] = DOT,
+    ['0' ... '9'] = DIGIT,
+};
+
+#define STATE(name) static size_t name(const char *buf, size_t len, size_t i, \
+                                       uint32_t ip_address, unsigned value, uint32_t *out)
+typedef size_t (*state_fn)(const char *buf, size_t len, size_t i,
+                           uint32_t ip_address, unsigned value, uint32_t *out);
+
+/*
+ * Tail-calls one of four states depending on the class of the
+ * next byte. The state finds its byte at `buf[i - 1]`.
+ */
+#define DISPATCH(other, digit, dot, term) do { \
+        static const state_fn targets[] = {other, digit, dot, term}; \
+        if (i >= len) \
+            return 0; \
+        MUSTTAIL return targets[char_class[(unsigned char)buf[i]]]( \
+                            buf, len, i + 1, ip_address, value, out); \
+    } while (0)
+
+STATE(error);
+STATE(done);
+STATE(start);
+STATE(num1_1); STATE(num1_2); STATE(num1_3); STATE(dot1);
+STATE(num2_1); STATE(num2_2); STATE(num2_3); STATE(dot2);
+STATE(num3_1); STATE(num3_2); STATE(num3_3); STATE(dot3);
+STATE(num4_1); STATE(num4_2); STATE(num4_3);
+
+/*
+ * The three digit states of an octet, ended by a dot or terminator.
+ */
+#define OCTET(k, dot, term) \
+    STATE(num##k##_1) { \
+        value = (unsigned char)buf[i - 1] - '0'; \
+        DISPATCH(error, num##k##_2, dot, term); \
+    } \
+    STATE(num##k##_2) { \
+        if (value == 0) \
+            return 0; /* no leading zeroes */ \
+        value = value * 10 + ((unsigned char)buf[i - 1] - '0'); \
+        DISPATCH(error, num##k##_3, dot, term); \
+    } \
+    STATE(num##k##_3) { \
+        value = value * 10 + ((unsigned char)buf[i - 1] - '0'); \
+        DISPATCH(error, error, dot, term); \
+    }
+
+OCTET(1, dot1, error)
+OCTET(2, dot2, error)
+OCTET(3, dot3, error)
+OCTET(4, error, done)
+
+STATE(dot1) {
+    ip_address = ip_address<<8 | value;
+    DISPATCH(error, num2_1, error, error);
+}
+STATE(dot2) {
+    ip_address = ip_address<<8 | value;
+    DISPATCH(error, num3_1, error, error);
+}
+STATE(dot3) {
+    ip_address = ip_address<<8 | value;
+    DISPATCH(error, num4_1, error, error);
+}
+
+STATE(done) {
+    (void)buf; (void)len;
+    *out = ip_address<<8 | value;
+    return i - 1;   /* bytes consumed (terminator not consumed) */
+}
+
+STATE(error) {
+    (void)buf; (void)len; (void)i; (void)ip_address; (void)value; (void)out;
+    return 0;
+}
+
+STATE(start) {
+    DISPATCH(error, num1_1, error, error);
+}
+
+size_t parse_ip_fsm_tail(const char *buf, size_t len, uint32_t *out)
+{
+    /* Not a tail call, since the signature is different */
+    return start(buf, len, 0, 0, 0, out);
+}
+
+#else
+size_t parse_ip_fsm_tail(const char *buf, size_t len, uint32_t *out)
+{
+    return parse_ip_fsm2(buf, len, out);
+}
+#endif
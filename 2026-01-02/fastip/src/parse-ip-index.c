@@ -0,0 +1,116 @@
+/*
+    Two-stage parsing: a structural index, then the parsers
+
+ This splits finding the addresses from parsing them, the way
+ `simdjson` does for JSON.
+
+ Stage 1, `parse_ip_index()`, looks at 64 bytes at a time with SIMD
+ compares and makes 64-bit masks of the separators (any byte <= ' '),
+ digits, and dots. Tokens start and end where the separator mask
+ changes, so XOR-ing it with itself shifted by one gives a bit at
+ every boundary. Those bits are turned into a flat array of offsets,
+ alternating start and end, with a tight loop over `ctz()`.
+
+ Tokens with anything other than digits and dots in them can't be
+ addresses, so stage 1 marks them too, with no per-token work: adding
+ the mask of bad bytes to the mask of token bytes makes a carry run
+ up to the end of each token that has one. Those end offsets get the
+ top bit set.
+
+ Stage 2, `parse_ip_index_parse()`, walks the offsets and hands each
+ token to a parser with its length already known. There's nothing
+ left for the parser to search for, and every token it sees has the
+ right characters, so its branches are predictable.
+
+ Offsets are 32 bits, so buffers must be under 2-GB.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse-ip-classify.h"
+
+size_t parse_ip_scalar_len(const char *buf, size_t length, uint32_t *out);
+
+#define END_BAD 0x80000000u
+
+/**
+ * Finds the tokens in `buf`. Writes their offsets to `offsets[]`,
+ * start then end for each token, where end is the offset of the
+ * separator after it (or `len`). Ends of tokens that contain bytes
+ * other than digits and dots have `END_BAD` set. `offsets[]` must
+ * have room for `len + 1` entries.
+ * @returns the number of offsets, twice the number of tokens
+ */
+size_t parse_ip_index(const char *buf, size_t len, uint32_t *offsets) {
+    uint64_t prev_token = 0;   /* was the last byte part of a token? */
+    uint64_t bad_carry = 0;    /* is there a bad byte in that token? */
+    size_t count = 0;
+    size_t offset;
+
+    for (offset=0; offset<len; offset += 64) {
+        struct byte_masks m;
+        uint64_t tokens, bounds, bad_ends, sum;
+        unsigned c1, c2;
+
+        if (len - offset >= 64)
+            m = classify64(buf + offset);
+        else {
+            /* Pad the last block with separators */
+            char tmp[64];
+            memset(tmp, ' ', sizeof(tmp));
+            memcpy(tmp, buf + offset, len - offset);
+            m = classify64(tmp);
+        }
+
+        tokens = ~m.seps;
+        bounds = tokens ^ (tokens << 1 | prev_token);
+        prev_token = tokens >> 63;
+
+        /* The carry out of a token with a bad byte lands on the
+         * separator after it */
+        c1 = __builtin_add_overflow(tokens, tokens & ~(m.digits | m.dots), &sum);
+        c2 = __builtin_add_overflow(sum, bad_carry, &sum);
+        bad_ends = sum & ~tokens;
+        bad_carry = c1 | c2;
+
+        while (bounds) {
+            uint32_t i = (uint32_t)__builtin_ctzll(bounds);
+            offsets[count++] = (uint32_t)(offset + i) | (uint32_t)((bad_ends >> i) & 1) * END_BAD;
+            bounds &= bounds - 1;
+        }
+    }
+
+    /* A token running up to the end of the buffer */
+    if (count & 1)
+        offsets[count++] = (uint32_t)len | (uint32_t)bad_carry * END_BAD;
+    return count;
+}
+
+/**
+ * Parses the tokens found by `parse_ip_index()` with `parse_len`, a
+ * parser that takes a token of a known length and returns that
+ * length if it's valid, like `parse_ip_sse_len()`. Those may read
+ * 16 bytes, so tokens near the end of `buf` use the scalar parser.
+ * @returns the number of addresses written to `out`
+ */
+size_t parse_ip_index_parse(const char *buf, size_t len, const uint32_t *offsets, size_t count,
+                            uint32_t *out, size_t (*parse_len)(const char *, size_t, uint32_t *)) {
+    size_t n = 0;
+    size_t i;
+
+    for (i=0; i+1<count; i += 2) {
+        uint32_t start = offsets[i];
+        uint32_t end = offsets[i + 1];
+        size_t length = end - start;
+
+        /* Skipping bad tokens makes `length` huge */
+        if (length - 7 > 8)
+            continue;
+        if (start + 16 <= len)
+            n += parse_len(buf + start, length, &out[n]) != 0;
+        else
+            n += parse_ip_scalar_len(buf + start, length, &out[n]) != 0;
+    }
+    return n;
+}
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #ifdef __ARM_NEON__
 #include <arm_neon.h>
@@ -37,6 +38,7 @@ static inline uint32_t neon_cmp_to_mask16(uint8x16_t cmp_ff_or_00)
 
     return mlo | (mhi << 8);
 #else
+    (void)cmp_ff_or_00;
     return 0;
 #endif
 }
@@ -74,33 +76,45 @@ static inline bool parse_octet_strict(const unsigned char *s, int pos, int len,
     *outv = v;
     return true;
 #else
+    (void)s; (void)pos; (void)len; (void)outv;
     return false;
 #endif
 }
 
-// Returns bytes consumed INCLUDING terminator (' ' or '\0'), or 0 on error.
+// Returns bytes consumed, not including the terminator (' ' or '\0'), or 0 on error.
 // Writes IPv4 as 0xAABBCCDD (A=first octet).
 size_t parse_ip_neon(const char *buf, size_t maxlen, uint32_t *out)
 {
 #ifdef __ARM_NEON__
     if (!buf || !out) return 0;
 
-    // Minimal form: "0.0.0.0\0" => 8 bytes consumed (7 chars + NUL)
-    if (maxlen < 8) return 0;
+    // Minimal form: "0.0.0.0" => 7 chars, terminated by NUL or the end of the buffer
+    if (maxlen < 7) return 0;
 
     const unsigned char *s = (const unsigned char *)buf;
+    unsigned char tmp[16] = {0};
+    uint8x16_t v;
 
     // We operate on the first 16 bytes; if token might be longer than 15 before terminator,
     // we reject (by requiring terminator within these 16).
     // For IPv4 dotted-quad, max is "255.255.255.255" (15 chars) + term, so we need term within 16 bytes.
-    if (maxlen < 16) {
-        // Safe scalar fallback for very short buffers (still strict).
-        // You can replace this with your own scalar path if desired.
-        return 0;
+    if (maxlen >= 16) {
+        v = vld1q_u8((const uint8_t *)s);
+    } else if (((uintptr_t)s & 4095) <= 4096 - 16) {
+        // Near the end of the buffer, but the 16-byte load can't cross into the
+        // next page, so it can't fault: load, then zero the bytes past the end.
+        static const uint8_t keep[32] = {
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        };
+        v = vandq_u8(vld1q_u8((const uint8_t *)s), vld1q_u8(keep + 16 - maxlen));
+    } else {
+        // The load would cross into the next page: copy the bytes out first.
+        memcpy(tmp, s, maxlen);
+        s = tmp;
+        v = vld1q_u8(tmp);
     }
 
-    uint8x16_t v = vld1q_u8((const uint8_t *)s);
-
     // Find '.' positions
     uint8x16_t is_dot = vceqq_u8(v, vdupq_n_u8((uint8_t)'.'));
     uint32_t dot_mask = neon_cmp_to_mask16(is_dot);
@@ -115,8 +129,8 @@ size_t parse_ip_neon(const char *buf, size_t maxlen, uint32_t *out)
 
     int term_i = ctz32(term_mask); // earliest terminator index 0..15
 
-    // terminator must be within maxlen (it is within first 16, but still guard)
-    if ((size_t)term_i >= maxlen) return 0;
+    // terminator must be within maxlen, or be the end of the buffer
+    if ((size_t)term_i > maxlen) return 0;
 
     // Only consider chars before the terminator.
     uint32_t pre_mask = (term_i == 0) ? 0u : ((1u << term_i) - 1u);
@@ -165,9 +179,10 @@ size_t parse_ip_neon(const char *buf, size_t maxlen, uint32_t *out)
 
     *out = ((uint32_t)a << 24) | ((uint32_t)b << 16) | ((uint32_t)c << 8) | (uint32_t)d;
 
-    // bytes consumed includes the terminator
-    return (size_t)term_i + 1u;
+    // bytes consumed, not including the terminator, like the other parsers
+    return (size_t)term_i;
 #else
+    (void)buf; (void)maxlen; (void)out;
     return 0;
 #endif
 }
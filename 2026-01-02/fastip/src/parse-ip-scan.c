@@ -0,0 +1,326 @@
+/*
+    Find IPv4 addresses in unsegmented text with a SIMD DFA
+
+ All the other parsers are told where an address starts. This one
+ is given a stream of text and finds them itself, with a DFA that
+ runs over every byte.
+
+ The trick for running a DFA with SIMD is to stop thinking of the
+ state and think of the *transition function* instead. If there
+ are at most 16 states, then what a byte does to the DFA is a
+ 16-byte table, `next = fn[state]`, and that's exactly what a
+ `pshufb` instruction computes. Composing two bytes is also just a
+ `pshufb` of one table by the other. So starting from the identity
+ table and shuffling in a byte at a time gives, after each byte,
+ the state we'd be in for *every* possible start state.
+
+ That means a chunk of text can be run without knowing the state
+ it starts in. We split each 64 bytes into four 16-byte chunks and
+ run them at the same time, as four independent chains of shuffles.
+ Then a short prefix pass picks the real start state of each chunk
+ from the end of the one before, and the match bits for that state
+ are selected from the ones recorded along the way.
+
+ To fit in 16 states, this DFA is a *filter*: it finds tokens that
+ look like `d.d.d.d` with 1 to 3 digits per octet (the last one
+ has any number), surrounded by delimiters. Each candidate is then
+ moved to the front of a vector and checked by the `sse` parser for
+ values over 255 and leading zeroes.
+
+ Call `parse_ip_scan_init()` first to build the tables.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+int parse_ip_has_sse41(void);
+
+enum {
+    IDLE=0,
+    NUM1_1, NUM1_2, NUM1_3, DOT1,
+    NUM2_1, NUM2_2, NUM2_3, DOT2,
+    NUM3_1, NUM3_2, NUM3_3, DOT3,
+    NUM4,
+    MATCH, /* a delimiter just after NUM4: an address ended here */
+    JUNK,  /* in a token that isn't an address */
+    STATES
+};
+
+enum {DIGIT, DOT, DELIM, WORD, CLASSES};
+
+static const uint8_t next_state[STATES][CLASSES] = {
+    /*           DIGIT   DOT   DELIM  WORD */
+    /* IDLE   */ {NUM1_1, JUNK, IDLE,  JUNK},
+    /* NUM1_1 */ {NUM1_2, DOT1, IDLE,  JUNK},
+    /* NUM1_2 */ {NUM1_3, DOT1, IDLE,  JUNK},
+    /* NUM1_3 */ {JUNK,   DOT1, IDLE,  JUNK},
+    /* DOT1   */ {NUM2_1, JUNK, IDLE,  JUNK},
+    /* NUM2_1 */ {NUM2_2, DOT2, IDLE,  JUNK},
+    /* NUM2_2 */ {NUM2_3, DOT2, IDLE,  JUNK},
+    /* NUM2_3 */ {JUNK,   DOT2, IDLE,  JUNK},
+    /* DOT2   */ {NUM3_1, JUNK, IDLE,  JUNK},
+    /* NUM3_1 */ {NUM3_2, DOT3, IDLE,  JUNK},
+    /* NUM3_2 */ {NUM3_3, DOT3, IDLE,  JUNK},
+    /* NUM3_3 */ {JUNK,   DOT3, IDLE,  JUNK},
+    /* DOT3   */ {NUM4,   JUNK, IDLE,  JUNK},
+    /* NUM4   */ {NUM4,   JUNK, MATCH, JUNK},
+    /* MATCH  */ {NUM1_1, JUNK, IDLE,  JUNK},
+    /* JUNK   */ {JUNK,   JUNK, IDLE,  JUNK},
+};
+
+static uint8_t classes[256];
+
+/* For each byte, the transition function as a `pshufb` table */
+static uint8_t byte_fn[256][STATES];
+
+void parse_ip_scan_init(void) {
+    unsigned c;
+
+    for (c=0; c<256; c++) {
+        unsigned s;
+
+        if (c >= '0' && c <= '9')
+            classes[c] = DIGIT;
+        else if (c == '.')
+            classes[c] = DOT;
+        else if ((c|0x20) >= 'a' && (c|0x20) <= 'z')
+            classes[c] = WORD;
+        else if (c == '_' || c >= 0x80)
+            classes[c] = WORD;
+        else
+            classes[c] = DELIM;
+
+        for (s=0; s<STATES; s++)
+            byte_fn[c][s] = next_state[s][classes[c]];
+    }
+}
+
+/**
+ * Runs the DFA one byte at a time, setting a bit in `*ends` for each
+ * byte that ends an address. This is for the last partial block,
+ * and for CPUs without the SIMD version.
+ */
+static uint64_t
+scan_scalar(const unsigned char *p, size_t len, unsigned *state) {
+    uint64_t ends = 0;
+    unsigned s = *state;
+    size_t i;
+
+    for (i=0; i<len; i++) {
+        s = next_state[s][classes[p[i]]];
+        ends |= (uint64_t)(s == MATCH) << i;
+    }
+    *state = s;
+    return ends;
+}
+
+/**
+ * Checks a candidate that ends just before `buf[end]`: no values over
+ * 255, no leading zeroes, and at most 3 digits in the last octet.
+ */
+static int
+check_scalar(const char *buf, size_t end, uint32_t *out) {
+    size_t start = end;
+    uint32_t result = 0;
+    unsigned value = 0;
+    unsigned digits = 0;
+
+    /* The DFA has made sure the token is only digits and dots */
+    while (start > 0 && end - start < 16 && classes[(unsigned char)buf[start - 1]] != DELIM)
+        start--;
+    if (start > 0 && classes[(unsigned char)buf[start - 1]] != DELIM)
+        return 0;
+
+    for (; start < end; start++) {
+        unsigned c = (unsigned char)buf[start];
+        if (c == '.') {
+            result = result << 8 | value;
+            value = 0;
+            digits = 0;
+            continue;
+        }
+        if (digits == 1 && value == 0)
+            return 0; /* no leading zeroes */
+        value = value * 10 + (c - '0');
+        if (++digits > 3 || value > 255)
+            return 0;
+    }
+    *out = result << 8 | value;
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSE41 __attribute__((target("sse4.1,popcnt")))
+
+size_t parse_ip_sse(const char *buf, size_t maxlen, uint32_t *out);
+
+/**
+ * Picks bit `s` from each of 16 masks, giving a 16-bit mask.
+ */
+SSE41 static inline uint32_t
+select_bits(const uint16_t masks[16], unsigned s) {
+    __m128i count = _mm_cvtsi32_si128((int)s);
+    __m128i lo = _mm_loadu_si128((const __m128i *)masks);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(masks + 8));
+
+    /* Move the bit to the top of each 16-bit lane, then pack the
+     * top bits together */
+    lo = _mm_slli_epi16(_mm_srl_epi16(lo, count), 15);
+    hi = _mm_slli_epi16(_mm_srl_epi16(hi, count), 15);
+    return (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+}
+
+/**
+ * Runs 64 bytes through the DFA, as four 16-byte chunks in parallel.
+ * Returns a bit for each byte that ends an address.
+ */
+SSE41 static uint64_t
+scan64(const unsigned char *p, unsigned *state) {
+    const __m128i match = _mm_set1_epi8(MATCH);
+    __m128i f0, f1, f2, f3;
+    uint16_t masks[4][16];
+    uint8_t fns[4][16];
+    uint64_t ends = 0;
+    unsigned s = *state;
+    unsigned i;
+
+    /* Each chunk starts as the identity function */
+    f0 = f1 = f2 = f3 = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    for (i=0; i<16; i++) {
+        f0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte_fn[p[i]]), f0);
+        f1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte_fn[p[i + 16]]), f1);
+        f2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte_fn[p[i + 32]]), f2);
+        f3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte_fn[p[i + 48]]), f3);
+
+        /* For each start state, whether this byte ends an address */
+        masks[0][i] = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(f0, match));
+        masks[1][i] = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(f1, match));
+        masks[2][i] = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(f2, match));
+        masks[3][i] = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(f3, match));
+    }
+    _mm_storeu_si128((__m128i *)fns[0], f0);
+    _mm_storeu_si128((__m128i *)fns[1], f1);
+    _mm_storeu_si128((__m128i *)fns[2], f2);
+    _mm_storeu_si128((__m128i *)fns[3], f3);
+
+    /* Now the start state of each chunk is the end state of the
+     * one before it */
+    for (i=0; i<4; i++) {
+        ends |= (uint64_t)select_bits(masks[i], s) << (16 * i);
+        s = fns[i][s];
+    }
+
+    *state = s;
+    return ends;
+}
+
+/**
+ * The same as `check_scalar()`, but it finds the start of the token
+ * from a mask of the 16 bytes before `end`, moves the token to the
+ * front of a vector followed by zeroes, and hands that to the `sse`
+ * parser. Needs `end >= 16`.
+ */
+SSE41 static int
+check_sse(const char *buf, size_t end, uint32_t *out) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + end - 16));
+    __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    __m128i is_dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+    uint32_t other = ~(uint32_t)_mm_movemask_epi8(_mm_or_si128(is_digit, is_dot)) & 0xFFFF;
+    char tmp[16];
+    int start;
+
+    /* The token starts after the last byte that isn't a digit or dot.
+     * If there isn't one, it's too long to be an address. */
+    if (other == 0)
+        return 0;
+    start = 32 - __builtin_clz(other);
+
+    /* Shift the token down, with zeroes (a terminator) after it */
+    __m128i idx = _mm_add_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                               _mm_set1_epi8((char)start));
+    idx = _mm_or_si128(idx, _mm_cmpgt_epi8(idx, _mm_set1_epi8(15)));
+    _mm_storeu_si128((__m128i *)tmp, _mm_shuffle_epi8(v, idx));
+
+    return parse_ip_sse(tmp, 16, out) == (size_t)(16 - start);
+}
+
+static int
+check_candidate(const char *buf, size_t end, uint32_t *out) {
+    if (end >= 16 && parse_ip_has_sse41())
+        return check_sse(buf, end, out);
+    return check_scalar(buf, end, out);
+}
+#else
+static uint64_t
+scan64(const unsigned char *p, unsigned *state) {
+    return scan_scalar(p, 64, state);
+}
+static int
+check_candidate(const char *buf, size_t end, uint32_t *out) {
+    return check_scalar(buf, end, out);
+}
+#endif
+
+/**
+ * Runs the DFA over the next (up to) 64 bytes.
+ */
+static uint64_t
+scan_block(const unsigned char *p, size_t len, unsigned *state) {
+    if (len >= 64 && parse_ip_has_sse41())
+        return scan64(p, state);
+    return scan_scalar(p, len < 64 ? len : 64, state);
+}
+
+/**
+ * Finds where addresses may end in `buf`. Sets bit `i` of `ends[]`
+ * if `buf[i]` is the delimiter after something shaped like an
+ * address, and bit `len` if the buffer ends with one. The caller
+ * must provide `len/64 + 1` words.
+ * @returns the number of candidates
+ */
+size_t parse_ip_scan_ends(const char *buf, size_t len, uint64_t *ends) {
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned state = IDLE;
+    size_t count = 0;
+    size_t offset;
+
+    for (offset=0; offset<len; offset += 64) {
+        uint64_t bits = scan_block(p + offset, len - offset, &state);
+        ends[offset / 64] = bits;
+        count += (size_t)__builtin_popcountll(bits);
+    }
+    if (len % 64 == 0)
+        ends[len / 64] = 0;
+    if (state == NUM4) {
+        ends[len / 64] |= 1ULL << (len % 64);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Finds all the IPv4 addresses in the text `buf`, writing up to
+ * `max` of them to `out`.
+ * @returns the number of addresses found
+ */
+size_t parse_ip_scan(const char *buf, size_t len, uint32_t *out, size_t max) {
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned state = IDLE;
+    size_t count = 0;
+    size_t offset;
+
+    for (offset=0; offset<len && count<max; offset += 64) {
+        uint64_t bits = scan_block(p + offset, len - offset, &state);
+        while (bits && count < max) {
+            size_t end = offset + (size_t)__builtin_ctzll(bits);
+            count += (size_t)check_candidate(buf, end, &out[count]);
+            bits &= bits - 1;
+        }
+    }
+    if (state == NUM4 && count < max)
+        count += (size_t)check_candidate(buf, len, &out[count]);
+    return count;
+}
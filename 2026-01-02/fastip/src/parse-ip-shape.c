@@ -0,0 +1,141 @@
+/*
+    IPv4 parser using a "shape" lookup table, for x86 SSE4.1
+
+ An address is four octets of 1 to 3 digits each, so there are only
+ 3*3*3*3 = 81 possible shapes. The positions of the dots and the
+ terminator identify the shape, and thus where every digit is.
+
+ So we make a 16-bit mask of the dots and the first terminator, hash
+ it into a small table, and get back a precomputed shuffle pattern
+ for that shape. One `pshufb` lines up the digits of each octet into
+ its own 32-bit lane, and one multiply-add turns them into four
+ octet values.
+
+ Validation is also table driven: a shape's entry holds its mask,
+ which must match exactly (the hash table maps any other mask to a
+ wrong entry), and the minimum value for each octet, which catches
+ leading zeroes ("01" is less than 10). There are no data-dependent
+ branches except the final one that rejects a bad address.
+
+ Like the `dfa` parser, the tables must be built first by calling
+ `parse_ip_shape_init()`.
+
+ Near the end of a buffer, the end is the terminator, and the load
+ is done by the same `load_tail()` as the `sse` parser.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse-ip-shape.h"
+
+/* Not static, so the batch parsers can use them too */
+struct shape parse_ip_shapes[82];
+uint8_t parse_ip_shape_index[256];
+
+void parse_ip_shape_init(void) {
+    static const uint8_t mins[4] = {0, 0, 10, 100};
+    unsigned l1, l2, l3, l4;
+    unsigned n = 1;
+
+    memset(parse_ip_shapes, 0, sizeof(parse_ip_shapes));
+    memset(parse_ip_shape_index, 0, sizeof(parse_ip_shape_index));
+    parse_ip_shapes[0].mask = 0xFFFFFFFF;
+
+    for (l1 = 1; l1 <= 3; l1++)
+    for (l2 = 1; l2 <= 3; l2++)
+    for (l3 = 1; l3 <= 3; l3++)
+    for (l4 = 1; l4 <= 3; l4++) {
+        struct shape *sh = &parse_ip_shapes[n];
+        unsigned lens[4] = {l1, l2, l3, l4};
+        unsigned start = 0;
+        unsigned k;
+        unsigned j;
+
+        memset(sh->shuffle, 0x80, sizeof(sh->shuffle));
+        for (k = 0; k < 4; k++) {
+            unsigned end = start + lens[k];
+
+            /* Right-align the digits into bytes 1..3 of the lane */
+            for (j = 0; j < lens[k]; j++)
+                sh->shuffle[k * 4 + 4 - lens[k] + j] = (uint8_t)(start + j);
+            sh->mask |= 1u << end;
+            sh->mins[k] = mins[lens[k]];
+            start = end + 1;
+        }
+        sh->length = start - 1;
+        parse_ip_shape_index[SHAPE_HASH(sh->mask)] = (uint8_t)n;
+        n++;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include "parse-ip-tail.h"
+#define SSE41 __attribute__((target("sse4.1")))
+
+/**
+ * Parses an address followed by a space or nul terminator, or by the
+ * end of the buffer.
+ * Returns bytes consumed NOT including terminator, or 0 on error.
+ */
+SSE41 size_t
+parse_ip_shape(const char *buf, size_t maxlen, uint32_t *out) {
+    __m128i v;
+
+    if (maxlen >= 16)
+        v = _mm_loadu_si128((const __m128i *)buf);
+    else if (maxlen >= 7)
+        v = load_tail(buf, maxlen);
+    else
+        return 0;
+    __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+
+    uint32_t dot_mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+    uint32_t term_mask = (uint32_t)_mm_movemask_epi8(
+                            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                         _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+    uint32_t digit_mask = (uint32_t)_mm_movemask_epi8(
+                            _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits));
+
+    /* Keep the dots up to and including the first terminator */
+    uint32_t t = term_mask & (0u - term_mask);
+    uint32_t pre = t * 2 - 1;
+    uint32_t m = (dot_mask | term_mask) & pre;
+
+    const struct shape *sh = &parse_ip_shapes[parse_ip_shape_index[SHAPE_HASH(m)]];
+
+    /* The shape must match, and everything else must be digits */
+    uint32_t err = (m != sh->mask) | (t == 0) | (((digit_mask | m) & pre) != pre);
+
+    __m128i shuffle = _mm_loadu_si128((const __m128i *)sh->shuffle);
+    __m128i aligned = _mm_shuffle_epi8(digits, shuffle);
+    __m128i vals = _mm_madd_epi16(
+                    _mm_maddubs_epi16(aligned, _mm_setr_epi8(0, 100, 10, 1, 0, 100, 10, 1,
+                                                             0, 100, 10, 1, 0, 100, 10, 1)),
+                    _mm_set1_epi16(1));
+
+    /* Leading zeroes make a value smaller than its minimum */
+    uint32_t mins4;
+    memcpy(&mins4, sh->mins, sizeof(mins4));
+    __m128i mins = _mm_cvtepu8_epi32(_mm_cvtsi32_si128((int)mins4));
+    __m128i bad = _mm_or_si128(_mm_cmpgt_epi32(mins, vals),
+                               _mm_cmpgt_epi32(vals, _mm_set1_epi32(255)));
+    err |= (uint32_t)_mm_movemask_epi8(bad);
+
+    if (err)
+        return 0;
+
+    /* Gather the low byte of each lane, first octet on top */
+    __m128i packed = _mm_shuffle_epi8(vals, _mm_setr_epi8(12, 8, 4, 0, -1, -1, -1, -1,
+                                                          -1, -1, -1, -1, -1, -1, -1, -1));
+    *out = (uint32_t)_mm_cvtsi128_si32(packed);
+    return sh->length;
+}
+
+#else
+size_t parse_ip_shape(const char *buf, size_t maxlen, uint32_t *out) {
+    (void)buf; (void)maxlen; (void)out;
+    return 0;
+}
+#endif
@@ -0,0 +1,31 @@
+#ifndef PARSE_IP_SHAPE_H
+#define PARSE_IP_SHAPE_H
+
+/*
+ * The shape tables from `parse-ip-shape.c`, shared with the batch
+ * parsers in `parse-ip-avx.c`, which look up one shape per lane.
+ * They're filled in by `parse_ip_shape_init()`.
+ */
+#include <stdint.h>
+
+/*
+ * Multiplier that hashes the 81 valid masks into 256 slots with no
+ * collisions. Found by searching random odd numbers.
+ */
+#define SHAPE_HASH(m) ((uint32_t)((m) * 0xe07bdb9fu) >> 24)
+
+struct shape {
+    uint8_t shuffle[16]; /* pshufb pattern, [0,h,t,u] per octet */
+    uint32_t mask;       /* dots + terminator that match this shape */
+    uint8_t mins[4];     /* smallest legal value of each octet */
+    uint32_t length;     /* position of the terminator */
+    uint32_t pad;        /* round up to 32 bytes */
+};
+
+/* Entry 0 is a sentinel whose mask never matches */
+extern struct shape parse_ip_shapes[82];
+extern uint8_t parse_ip_shape_index[256];
+
+void parse_ip_shape_init(void);
+
+#endif
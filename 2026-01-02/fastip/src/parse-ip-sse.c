@@ -0,0 +1,192 @@
+/*
+    Parser for IPv4 address using x86 SSE4.1 instructions
+
+ This is the same algorithm as the NEON parser, ported to x86 so
+ that there's a SIMD row on Intel/AMD machines. It finds the dots
+ and terminator with `_mm_cmpeq_epi8()` and `_mm_movemask_epi8()`,
+ validates digits in the vector, then instead of parsing each
+ octet with scalar code, it shuffles the digits of each octet into
+ its own 32-bit lane and multiplies them by 100/10/1 to get all
+ four values at once.
+
+ The functions are compiled with `target("sse4.1,popcnt")` so that the
+ default `-O2` build (which targets only SSE2) still gets them.
+ The caller must check the CPU supports SSE4.1 and POPCNT first,
+ with `parse_ip_has_sse41()`.
+
+ An address at the very end of a buffer may have fewer than 16 bytes
+ after it, and reading past the end can fault if the buffer ends at
+ a page boundary. In that case the end of the buffer terminates the
+ address: see `load_tail()` in `parse-ip-tail.h`.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include "parse-ip-tail.h"
+#define SSE41 __attribute__((target("sse4.1,popcnt")))
+
+/**
+ * Convert the four octet boundaries into a vector holding the same
+ * byte value in all 4 bytes of each 32-bit lane.
+ */
+SSE41 static inline __m128i
+lanes_u8(int x0, int x1, int x2, int x3) {
+    __m128i v = _mm_setr_epi32(x0, x1, x2, x3);
+    return _mm_mullo_epi32(v, _mm_set1_epi32(0x01010101));
+}
+
+/**
+ * Decode four octets whose digits end just before `ends[k]` and
+ * start at `starts[k]`. Each octet is right-aligned into a 32-bit
+ * lane as [pad, hundreds, tens, ones], then a multiply-add converts
+ * them to binary. Sets *err nonzero on leading zeroes or values
+ * over 255.
+ */
+SSE41 static inline uint32_t
+decode_octets(__m128i v, __m128i starts, __m128i ends, uint32_t *err) {
+    const __m128i offsets = _mm_setr_epi8(-4, -3, -2, -1, -4, -3, -2, -1,
+                                          -4, -3, -2, -1, -4, -3, -2, -1);
+    const __m128i weights = _mm_setr_epi8(0, 100, 10, 1, 0, 100, 10, 1,
+                                          0, 100, 10, 1, 0, 100, 10, 1);
+
+    /* Shuffle indexes, with any index before the start of the octet
+     * forced to 0xFF so that `pshufb` zeroes it */
+    __m128i idx = _mm_add_epi8(ends, offsets);
+    idx = _mm_or_si128(idx, _mm_cmpgt_epi8(starts, idx));
+
+    __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i aligned = _mm_shuffle_epi8(digits, idx);
+
+    /* [0*pad + 100*h, 10*t + 1*u] then sum the pairs */
+    __m128i pairs = _mm_maddubs_epi16(aligned, weights);
+    __m128i vals = _mm_madd_epi16(pairs, _mm_set1_epi16(1));
+
+    /* Leading zero: the first digit is '0' and there's more than one */
+    __m128i first = _mm_shuffle_epi8(v, starts);
+    __m128i is_zero = _mm_cmpeq_epi8(first, _mm_set1_epi8('0'));
+    __m128i multi = _mm_cmpgt_epi8(_mm_sub_epi8(ends, starts), _mm_set1_epi8(1));
+    __m128i bad = _mm_and_si128(is_zero, multi);
+
+    /* Range check */
+    bad = _mm_or_si128(bad, _mm_cmpgt_epi32(vals, _mm_set1_epi32(255)));
+    *err |= (uint32_t)_mm_movemask_epi8(bad);
+
+    /* Narrow the four 32-bit values into four bytes, a.b.c.d */
+    __m128i packed = _mm_packus_epi16(_mm_packus_epi32(vals, vals), _mm_setzero_si128());
+    return __builtin_bswap32((uint32_t)_mm_cvtsi128_si32(packed));
+}
+
+/**
+ * Parses the address in the first `term_i` bytes of `v`.
+ * Returns `term_i`, or 0 on error.
+ */
+SSE41 static inline size_t
+parse_terminated(__m128i v, int term_i, uint32_t *out) {
+    /* Find '.' positions */
+    __m128i is_dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+    uint32_t dot_mask = (uint32_t)_mm_movemask_epi8(is_dot);
+
+    /* Only consider chars before the terminator */
+    uint32_t pre_mask = (1u << term_i) - 1u;
+    uint32_t dots_before = dot_mask & pre_mask;
+    if (__builtin_popcount(dots_before) != 3)
+        return 0;
+
+    /* digit: c-'0' is unsigned 0..9, or min(c-'0',9) == c-'0' */
+    __m128i digits = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    uint32_t allowed_mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(is_digit, is_dot));
+    if ((allowed_mask & pre_mask) != pre_mask)
+        return 0;
+
+    /* Extract dot indices (d1 < d2 < d3) */
+    uint32_t m = dots_before;
+    int d1 = __builtin_ctz(m); m &= (m - 1u);
+    int d2 = __builtin_ctz(m); m &= (m - 1u);
+    int d3 = __builtin_ctz(m);
+
+    /* Each octet must be 1..3 digits */
+    if ((unsigned)(d1 - 1) > 2u) return 0;
+    if ((unsigned)(d2 - d1 - 2) > 2u) return 0;
+    if ((unsigned)(d3 - d2 - 2) > 2u) return 0;
+    if ((unsigned)(term_i - d3 - 2) > 2u) return 0;
+
+    uint32_t err = 0;
+    uint32_t result = decode_octets(v,
+                                    lanes_u8(0, d1 + 1, d2 + 1, d3 + 1),
+                                    lanes_u8(d1, d2, d3, term_i),
+                                    &err);
+    if (err)
+        return 0;
+
+    *out = result;
+    return (size_t)term_i;
+}
+
+/**
+ * Parses an address followed by a space or nul terminator, or by the
+ * end of the buffer.
+ * Returns bytes consumed NOT including terminator, or 0 on error.
+ */
+SSE41 size_t
+parse_ip_sse(const char *buf, size_t maxlen, uint32_t *out) {
+    __m128i v;
+
+    /* Minimal form: "0.0.0.0", and we load 16 bytes at a time */
+    if (maxlen >= 16)
+        v = _mm_loadu_si128((const __m128i *)buf);
+    else if (maxlen >= 7)
+        v = load_tail(buf, maxlen);
+    else
+        return 0;
+
+    /* Find terminator positions: ' ' or '\0' */
+    __m128i is_term = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                   _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    uint32_t term_mask = (uint32_t)_mm_movemask_epi8(is_term);
+    if (term_mask == 0)
+        return 0;
+
+    return parse_terminated(v, __builtin_ctz(term_mask), out);
+}
+
+/**
+ * Parses an address that's exactly `length` bytes, for callers that
+ * have already found where it ends. There must be 16 bytes readable.
+ * Returns `length`, or 0 on error.
+ */
+SSE41 size_t
+parse_ip_sse_len(const char *buf, size_t length, uint32_t *out) {
+    if (length - 7 > 8)
+        return 0;
+    return parse_terminated(_mm_loadu_si128((const __m128i *)buf), (int)length, out);
+}
+
+/**
+ * Checks that this CPU has what the functions above were compiled
+ * for. The answer is cached, so it's cheap enough to ask per call.
+ */
+int
+parse_ip_has_sse41(void) {
+    static int result = -1;
+    if (result < 0)
+        result = __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+    return result;
+}
+
+#else
+size_t parse_ip_sse(const char *buf, size_t maxlen, uint32_t *out) {
+    (void)buf; (void)maxlen; (void)out;
+    return 0;
+}
+size_t parse_ip_sse_len(const char *buf, size_t length, uint32_t *out) {
+    (void)buf; (void)length; (void)out;
+    return 0;
+}
+int parse_ip_has_sse41(void) {
+    return 0;
+}
+#endif
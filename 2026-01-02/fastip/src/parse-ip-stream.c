@@ -0,0 +1,223 @@
+/*
+    Streaming API: parse all the addresses in a buffer
+
+ The benchmark calls each parser with a pointer to where an address
+ starts, but that's not how real code uses them. A log ingester has
+ a buffer of text, with addresses separated by runs of whitespace,
+ and the buffer ends wherever the last `read()` stopped.
+
+     size_t parse_ip_stream(const char *buf, size_t len,
+                            uint32_t *out, size_t max_out,
+                            size_t *consumed);
+
+ This parses addresses from `buf` into `out` until the buffer or
+ `out` is full. It returns the number of addresses, and sets
+ `*consumed` to how far it got. The caller should keep the bytes
+ after that and call again once it has more. A token at the end of
+ the buffer with no separator after it might be cut short, so it's
+ never parsed, but left unconsumed for the next call. At the end
+ of the input, add a newline (or nul) after the last address.
+
+ A separator is any byte <= ' ', which covers space, tab, CR, LF,
+ and nul. Tokens that aren't valid addresses are skipped.
+
+ There's one version for each family of parser:
+ - `_sse` finds the separators 16 bytes at a time with SSE, and
+   hands each token to the `sse` parser's decoder.
+ - `_swar` does the same with the 64-bit tricks of `swar2`.
+ - `_dfa` and `_fsm` find the separators the same way as `_swar`,
+   but check each token with the compact `dfa` tables or the `fsm`
+   state machine, so those families can be compared on a real
+   buffer too. `_dfa` needs `parse_ip_dfa_init()`.
+ - `_scalar` goes a byte at a time, and is also what the others
+   use for the last 15 bytes of the buffer, so they never read
+   past the end.
+ The plain `parse_ip_stream()` picks the best one for the CPU.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+size_t parse_ip_sse_len(const char *buf, size_t length, uint32_t *out);
+int parse_ip_has_sse41(void);
+size_t parse_ip_swar2_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_ip_dfa_len(const char *buf, size_t length, uint32_t *out);
+size_t parse_ip_fsm(const char *buf, size_t len, uint32_t *out);
+
+static inline int is_separator(char c) {
+    return (unsigned char)c <= ' ';
+}
+
+/**
+ * Parses a token of exactly `length` bytes, a byte at a time.
+ * Returns `length` if it's a valid address, else 0.
+ */
+size_t
+parse_ip_scalar_len(const char *p, size_t length, uint32_t *out) {
+    uint32_t result = 0;
+    unsigned value = 0;
+    unsigned digits = 0;
+    unsigned dots = 0;
+    size_t i;
+
+    if (length - 7 > 8)
+        return 0;
+    for (i=0; i<length; i++) {
+        unsigned c = (unsigned char)p[i];
+        if (c == '.') {
+            if (digits == 0 || ++dots > 3)
+                return 0;
+            result = result << 8 | value;
+            value = 0;
+            digits = 0;
+            continue;
+        }
+        if (c - '0' > 9)
+            return 0;
+        if (digits == 1 && value == 0)
+            return 0; /* no leading zeroes */
+        value = value * 10 + (c - '0');
+        if (++digits > 3 || value > 255)
+            return 0;
+    }
+    if (digits == 0 || dots != 3)
+        return 0;
+    *out = result << 8 | value;
+    return length;
+}
+
+/**
+ * The byte-at-a-time version, starting at offset `i` with `n`
+ * addresses already found.
+ */
+static size_t
+stream_scalar(const char *buf, size_t len, size_t i,
+              uint32_t *out, size_t max_out, size_t n, size_t *consumed) {
+    while (n < max_out) {
+        size_t start;
+
+        while (i < len && is_separator(buf[i]))
+            i++;
+        start = i;
+        while (i < len && !is_separator(buf[i]))
+            i++;
+        if (i == len) {
+            /* No separator yet, so this token may be incomplete */
+            i = start;
+            break;
+        }
+        n += parse_ip_scalar_len(buf + start, i - start, &out[n]) != 0;
+    }
+    *consumed = i;
+    return n;
+}
+
+size_t
+parse_ip_stream_scalar(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed) {
+    return stream_scalar(buf, len, 0, out, max_out, 0, consumed);
+}
+
+/*
+ * The loop for the versions that look at 16 bytes at a time.
+ * `sep_mask(p)` returns a bit for each separator in p[0..15], and
+ * `parse_len(p, length, out)` parses a token of `length` bytes.
+ *
+ * In the usual case, one mask gives the end of the token and the
+ * separators after it, so it's one load per address.
+ */
+#define STREAM_LOOP(name, ATTR, sep_mask, parse_len) \
+ATTR size_t \
+name(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed) { \
+    size_t i = 0; \
+    size_t n = 0; \
+    \
+    while (n < max_out && i + 16 <= len) { \
+        uint32_t m = sep_mask(buf + i); \
+        size_t length; \
+        \
+        if (m == 0) { \
+            /* Too long to be an address: skip to the next separator */ \
+            size_t j = i + 16; \
+            while (j + 16 <= len && (m = sep_mask(buf + j)) == 0) \
+                j += 16; \
+            if (j + 16 > len) \
+                break; \
+            i = j + (size_t)__builtin_ctz(m); \
+            continue; \
+        } \
+        \
+        length = (size_t)__builtin_ctz(m); \
+        if (length) \
+            n += parse_len(buf + i, length, &out[n]) != 0; \
+        \
+        /* Skip the separators after the token */ \
+        i += length + (size_t)__builtin_ctz(~(m >> length)); \
+    } \
+    \
+    return stream_scalar(buf, len, i, out, max_out, n, consumed); \
+}
+
+#define LOWS 0x7F7F7F7F7F7F7F7FULL
+#define HIGHS 0x8080808080808080ULL
+
+/**
+ * Bit `i` set for each byte `i` of the 16 that's <= ' '.
+ */
+static inline uint32_t
+sep_mask_swar(const char *p) {
+    uint64_t w[2];
+    uint32_t m = 0;
+    int k;
+
+    memcpy(w, p, sizeof(w));
+    for (k=0; k<2; k++) {
+        /* The high bit of (x & 0x7F) + (0x80 - 0x21) is set when the
+         * byte is 0x21 or more, or already set if it's 0x80 or more */
+        uint64_t x = w[k];
+        uint64_t ge = ((x & LOWS) + 0x5F5F5F5F5F5F5F5FULL) | x;
+        uint64_t lt = ~ge & HIGHS;
+        m |= (uint32_t)(((lt >> 7) * 0x0102040810204080ULL) >> 56) << (8 * k);
+    }
+    return m;
+}
+
+STREAM_LOOP(parse_ip_stream_swar, , sep_mask_swar, parse_ip_swar2_len)
+STREAM_LOOP(parse_ip_stream_dfa, , sep_mask_swar, parse_ip_dfa_len)
+
+/**
+ * `parse_ip_fsm()` on a token of `length` bytes. It takes the end of
+ * the buffer as the end of the address, so it's valid only if all of
+ * it was used.
+ */
+static inline size_t
+parse_ip_fsm_len(const char *p, size_t length, uint32_t *out) {
+    return parse_ip_fsm(p, length, out) == length ? length : 0;
+}
+
+STREAM_LOOP(parse_ip_stream_fsm, , sep_mask_swar, parse_ip_fsm_len)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SSE41 __attribute__((target("sse4.1,popcnt")))
+
+SSE41 static inline uint32_t
+sep_mask_sse(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(' ')), v);
+    return (uint32_t)_mm_movemask_epi8(le);
+}
+
+STREAM_LOOP(parse_ip_stream_sse, SSE41, sep_mask_sse, parse_ip_sse_len)
+#else
+size_t
+parse_ip_stream_sse(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed) {
+    return parse_ip_stream_swar(buf, len, out, max_out, consumed);
+}
+#endif
+
+size_t
+parse_ip_stream(const char *buf, size_t len, uint32_t *out, size_t max_out, size_t *consumed) {
+    if (parse_ip_has_sse41())
+        return parse_ip_stream_sse(buf, len, out, max_out, consumed);
+    return parse_ip_stream_swar(buf, len, out, max_out, consumed);
+}
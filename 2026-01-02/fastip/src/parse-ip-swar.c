@@ -13,6 +13,10 @@
  This executes more instructions over all, essentially parsing
  each number three times, once each for the number of digits
  it might have. It then masks off the correct results at the end.
+
+ It reads up to 16 bytes, whatever the address, so with fewer than
+ that left in the buffer, the bytes are first copied out and padded
+ with a nul terminator. That's the only branch.
  */
 #include <stdint.h>
 #include <stddef.h>
@@ -155,6 +159,12 @@ parse_octet_last(const uint8_t *p, uint32_t *val, uint32_t *ndigits, uint8_t *te
 size_t
 parse_ip_swar(const char *s, size_t len, uint32_t *out) {
 
+    if (len < 16) {
+        char tmp[16] = {0};
+        memcpy(tmp, s, len);
+        return parse_ip_swar(tmp, 16, out);
+    }
+
     const uint8_t *p = (uint8_t*)s;
     uint32_t err = 0;
     uint32_t a, b, c, d;
@@ -0,0 +1,209 @@
+/*
+    Parse IPv4 address - SWAR on whole 64-bit words
+
+ The `swar` parser works a byte at a time, and parses every octet
+ three times, once for each possible number of digits. This one
+ instead loads the 16 bytes as two `uint64_t` words and works on
+ all the bytes at once:
+
+ - The dots, terminators, and digits are found with the classic
+   "has zero byte" bit trick, then compressed into 16-bit masks
+   with a multiply.
+ - The octet boundaries come from `ctz()` of those masks, and
+   the leading-zero check is done on the masks too.
+ - Each octet is pulled out of the words with a shift, which also
+   right-aligns its digits, and then two octets at a time are
+   turned into binary with a couple of multiplies by magic
+   constants, the trick used in fast integer parsers.
+
+ Like `swar`, there are no `if` statements: errors are accumulated
+ in a flag. It's portable C, so it's meant for machines where the
+ SIMD parsers aren't available.
+
+ This assumes a little-endian CPU.
+
+ With fewer than 16 bytes left in the buffer, the end of the buffer
+ is the terminator. The words are still loaded directly when that
+ can't cross into the next page, with the bytes past the end masked
+ to zero, else they are copied out first.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+#define LOWS  0x7F7F7F7F7F7F7F7FULL
+
+static inline uint64_t load64(const char *p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+/**
+ * Sets the high bit of every byte that is zero. This is the exact
+ * version of the trick, without false positives caused by borrows.
+ */
+static inline uint64_t zero_bytes(uint64_t x) {
+    return ~(((x & LOWS) + LOWS) | x | LOWS);
+}
+
+/**
+ * Sets the high bit of every byte equal to `c`.
+ */
+static inline uint64_t eq_bytes(uint64_t x, uint8_t c) {
+    return zero_bytes(x ^ (ONES * c));
+}
+
+/**
+ * Sets the high bit of every byte that is '0'..'9': XOR with '0'
+ * leaves 0..9, and adding 0x76 to the low 7 bits of anything 10 or
+ * more sets the high bit.
+ */
+static inline uint64_t digit_bytes(uint64_t x) {
+    uint64_t y = x ^ (ONES * '0');
+    return ~(((y & LOWS) + ONES * (0x80 - 10)) | y) & HIGHS;
+}
+
+/**
+ * Sets the high bit of every byte that is a terminator, ' ' or '\0'.
+ * Those are the only two bytes where all bits but 0x20 are zero.
+ */
+static inline uint64_t term_bytes(uint64_t x) {
+    return zero_bytes(x & (ONES * 0xDF));
+}
+
+/**
+ * Compress the high bit of each byte into an 8-bit mask, bit `i`
+ * for byte `i`.
+ */
+static inline uint32_t to_bits(uint64_t m) {
+    return (uint32_t)(((m >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+/**
+ * The 4 bytes starting at byte `s` (0..15) of the 16 bytes in lo/hi.
+ */
+static inline uint32_t window32(uint64_t lo, uint64_t hi, uint32_t s) {
+    uint32_t sh = (s * 8) & 63;
+    uint64_t a = (lo >> sh) | ((hi << 1) << (63 - sh));
+    uint64_t b = hi >> sh;
+    return (uint32_t)(s < 8 ? a : b);
+}
+
+/**
+ * Decode two octets, each right-aligned in a 32-bit half as
+ * [pad, hundreds, tens, ones] (first byte lowest). Returns
+ * the first in bits 16..31 and the second in bits 48..63.
+ */
+static inline uint64_t decode_pair(uint64_t x) {
+    x &= 0x0F0F0F0F0F0F0F0FULL;
+    /* pad*10+hundreds, tens*10+ones, in every other byte */
+    x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+    /* (hundreds)*100 + (tens*10+ones) */
+    return x * (1 + (100ULL << 16));
+}
+
+/**
+ * Parses the address in the first `term_i` bytes of lo/hi, where
+ * `term_i` is 0..16. Returns `term_i`, or 0 on error.
+ */
+static inline size_t
+parse_terminated(uint64_t lo, uint64_t hi, uint32_t term_i, uint32_t err, uint32_t *out) {
+    uint32_t dots = to_bits(eq_bytes(lo, '.')) | to_bits(eq_bytes(hi, '.')) << 8;
+    uint32_t digits = to_bits(digit_bytes(lo)) | to_bits(digit_bytes(hi)) << 8;
+
+    /* The guard bits make ctz() safe when something is missing */
+    uint32_t pre = (1u << term_i) - 1;
+    uint32_t m = (dots & pre) | 0x70000;
+    uint32_t d1 = (uint32_t)__builtin_ctz(m); m &= m - 1;
+    uint32_t d2 = (uint32_t)__builtin_ctz(m); m &= m - 1;
+    uint32_t d3 = (uint32_t)__builtin_ctz(m); m &= m - 1;
+
+    /* Exactly 3 dots, and everything else digits */
+    err |= (term_i == 16);
+    err |= (m != 0x70000);
+    err |= ((digits | dots) & pre) != pre;
+
+    /* No leading zeroes: a '0' starting an octet followed by a digit */
+    uint32_t zeros = to_bits(eq_bytes(lo, '0')) | to_bits(eq_bytes(hi, '0')) << 8;
+    err |= (zeros & (dots << 1 | 1) & ((digits & pre) >> 1) & pre) != 0;
+
+    /* Octet lengths, which must be 1..3 */
+    uint32_t l1 = d1, l2 = d2 - d1 - 1, l3 = d3 - d2 - 1, l4 = term_i - d3 - 1;
+    err |= (l1 - 1 > 2) | (l2 - 1 > 2) | (l3 - 1 > 2) | (l4 - 1 > 2);
+
+    /* Fetch each octet and shift its digits to the top of 32 bits */
+    uint32_t w1 = (uint32_t)lo;
+    uint32_t w2 = window32(lo, hi, d1 + 1);
+    uint32_t w3 = window32(lo, hi, d2 + 1);
+    uint32_t w4 = window32(lo, hi, d3 + 1);
+    uint64_t x12 = (uint64_t)(w1 << ((32 - 8 * l1) & 31))
+                 | (uint64_t)(w2 << ((32 - 8 * l2) & 31)) << 32;
+    uint64_t x34 = (uint64_t)(w3 << ((32 - 8 * l3) & 31))
+                 | (uint64_t)(w4 << ((32 - 8 * l4) & 31)) << 32;
+
+    uint64_t v12 = decode_pair(x12);
+    uint64_t v34 = decode_pair(x34);
+
+    /* Values over 255 have bits set in the high byte of their field */
+    err |= ((v12 | v34) & 0xFF000000FF000000ULL) != 0;
+
+    uint32_t a = (uint32_t)(v12 >> 16) & 0xFF;
+    uint32_t b = (uint32_t)(v12 >> 48) & 0xFF;
+    uint32_t c = (uint32_t)(v34 >> 16) & 0xFF;
+    uint32_t d = (uint32_t)(v34 >> 48) & 0xFF;
+
+    *out = (a << 24) | (b << 16) | (c << 8) | d;
+    return term_i * (err == 0);
+}
+
+/**
+ * Loads the last `len` (7 to 15) bytes of a buffer into two words,
+ * with zeroes after them, without reading into the next page.
+ */
+static void
+load_tail(const char *s, size_t len, uint64_t *lo, uint64_t *hi) {
+    if (((uintptr_t)s & 4095) <= 4096 - 16) {
+        uint64_t keep_lo = len >= 8 ? ~0ULL : (1ULL << (8 * len)) - 1;
+        uint64_t keep_hi = len >= 8 ? (1ULL << (8 * (len - 8))) - 1 : 0;
+        *lo = load64(s) & keep_lo;
+        *hi = load64(s + 8) & keep_hi;
+    } else {
+        char tmp[16] = {0};
+        memcpy(tmp, s, len);
+        *lo = load64(tmp);
+        *hi = load64(tmp + 8);
+    }
+}
+
+size_t
+parse_ip_swar2(const char *s, size_t len, uint32_t *out) {
+    uint64_t lo, hi;
+    uint32_t terms, term_i;
+
+    /* Minimal form: "0.0.0.0" */
+    if (len >= 16) {
+        lo = load64(s);
+        hi = load64(s + 8);
+    } else if (len >= 7)
+        load_tail(s, len, &lo, &hi);
+    else
+        return 0;
+    terms = to_bits(term_bytes(lo)) | to_bits(term_bytes(hi)) << 8;
+    term_i = (uint32_t)__builtin_ctz(terms | 0x10000);
+
+    return parse_terminated(lo, hi, term_i, 0, out);
+}
+
+/**
+ * Parses an address that's exactly `length` bytes, for callers that
+ * have already found where it ends. There must be 16 bytes readable.
+ * Returns `length`, or 0 on error.
+ */
+size_t
+parse_ip_swar2_len(const char *s, size_t length, uint32_t *out) {
+    uint32_t term_i = (uint32_t)(length < 16 ? length : 16);
+    return parse_terminated(load64(s), load64(s + 8), term_i, (length - 7 > 8), out);
+}
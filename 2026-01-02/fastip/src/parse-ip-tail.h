@@ -0,0 +1,37 @@
+#ifndef PARSE_IP_TAIL_H
+#define PARSE_IP_TAIL_H
+
+/*
+ * The page-safe 16-byte load used near the end of a buffer by the
+ * `sse` and `shape` parsers. Only for x86.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+/**
+ * Loads the last `maxlen` (7 to 15) bytes of a buffer, with zeroes
+ * after them, which act as the terminator. Reading past the end of
+ * the buffer can only fault if it crosses into the next page (which
+ * is at least 4-KB), so if it doesn't, the bytes are loaded directly
+ * and the extra ones masked off. Otherwise, they are copied out.
+ */
+__attribute__((target("sse2"))) static inline __m128i
+load_tail(const char *buf, size_t maxlen) {
+    static const uint8_t keep[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    };
+    __m128i mask = _mm_loadu_si128((const __m128i *)(keep + 16 - maxlen));
+
+    if (((uintptr_t)buf & 4095) <= 4096 - 16)
+        return _mm_and_si128(_mm_loadu_si128((const __m128i *)buf), mask);
+    else {
+        char tmp[16] = {0};
+        memcpy(tmp, buf, maxlen);
+        return _mm_loadu_si128((const __m128i *)tmp);
+    }
+}
+
+#endif
@@ -0,0 +1,347 @@
+/*
+    Sorting and de-duplicating addresses
+
+ After parsing, target lists and blocklists are usually sorted and
+ de-duplicated. `qsort()` takes a function call per compare and
+ n*log(n) compares. An LSD radix sort takes a fixed number of passes
+ over the data instead, each one stable, from the lowest digit to
+ the highest:
+ - 8-bit digits, 4 passes with 256 buckets each, or
+ - 11-bit digits, 3 passes (11, 11, and 10 bits) with 2048 buckets,
+   which is fewer passes, but more places being written to at once.
+
+ With one thread, the histograms for all the passes are counted in a
+ single read before any of them, so each pass is only a scatter. A
+ pass where every address has the same digit (such as the top byte
+ of a list all in 10.0.0.0/8) does nothing, so it's skipped.
+
+ De-duplicating is part of the last pass. Addresses arrive in each
+ bucket in sorted order, because every pass is stable, so a duplicate
+ is always the same as the last address put in its bucket. Each
+ bucket keeps its last address, and only moves on to the next slot
+ if the new one is different. The buckets then have gaps at their
+ ends, which are closed up while copying them to their final place.
+
+ With several threads, each pass is split in two. First each thread
+ counts the digits in its own slice of the array. Then, with the
+ counts added up in order, each thread scatters its slice into its
+ own part of every bucket, so no two threads write the same place.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define HAVE_PTHREADS 1
+#endif
+
+enum { MAX_PASSES = 4, MAX_BUCKETS = 2048, MAX_THREADS = 256 };
+
+struct digits {
+    unsigned passes;
+    unsigned shift[MAX_PASSES];
+    uint32_t mask[MAX_PASSES];
+    size_t buckets;
+};
+
+static struct digits
+make_digits(unsigned digit_bits) {
+    struct digits d;
+    unsigned p;
+
+    if (digit_bits != 11)
+        digit_bits = 8;
+    d.passes = (32 + digit_bits - 1) / digit_bits;
+    d.buckets = (size_t)1 << digit_bits;
+    for (p=0; p<d.passes; p++) {
+        unsigned width = 32 - p * digit_bits < digit_bits ? 32 - p * digit_bits : digit_bits;
+        d.shift[p] = p * digit_bits;
+        d.mask[p] = (uint32_t)((1ULL << width) - 1);
+    }
+    return d;
+}
+
+/**
+ * The first address put in each bucket of the top digit must not look
+ * like a duplicate, so each starts with an address from the bucket
+ * below it (or, for bucket 0, the top one).
+ */
+static void
+init_last(uint32_t *last, const struct digits *d) {
+    size_t b;
+
+    for (b=0; b<d->buckets; b++)
+        last[b] = (uint32_t)(b << d->shift[d->passes - 1]) - 1;
+}
+
+/**
+ * Scatters src[] into dst[] by one digit, starting each bucket at
+ * `pos[]`. If `last` is set, duplicates are dropped, and `pos[]` is
+ * left at the end of each bucket's addresses.
+ */
+static void
+scatter(const uint32_t *src, size_t n, uint32_t *dst, size_t *pos, unsigned shift, uint32_t mask, uint32_t *last) {
+    size_t i;
+
+    if (last == NULL) {
+        for (i=0; i<n; i++) {
+            uint32_t x = src[i];
+            dst[pos[(x >> shift) & mask]++] = x;
+        }
+    } else {
+        /* A duplicate is written, but the slot isn't kept */
+        for (i=0; i<n; i++) {
+            uint32_t x = src[i];
+            size_t b = (x >> shift) & mask;
+            dst[pos[b]] = x;
+            pos[b] += x != last[b];
+            last[b] = x;
+        }
+    }
+}
+
+/**
+ * @returns 1 if every address has the same digit, so the pass can be
+ * skipped
+ */
+static int
+is_trivial(const size_t *hist, size_t buckets, size_t n) {
+    size_t b;
+
+    for (b=0; b<buckets; b++) {
+        if (hist[b] != 0)
+            return hist[b] == n;
+    }
+    return 1;
+}
+
+static size_t
+sort_single(uint32_t *a, size_t n, uint32_t *tmp, const struct digits *d, int unique) {
+    size_t *hist = calloc(MAX_PASSES * d->buckets, sizeof(*hist));
+    size_t *pos = malloc(d->buckets * sizeof(*pos));
+    size_t *start = malloc(d->buckets * sizeof(*start));
+    uint32_t *last = unique ? malloc(d->buckets * sizeof(*last)) : NULL;
+    uint32_t *src = a;
+    uint32_t *dst = tmp;
+    size_t count = n;
+    unsigned p;
+    size_t i, b;
+
+    /* All the histograms, in one read */
+    for (i=0; i<n; i++) {
+        uint32_t x = a[i];
+        for (p=0; p<d->passes; p++)
+            hist[p * d->buckets + ((x >> d->shift[p]) & d->mask[p])]++;
+    }
+
+    for (p=0; p<d->passes; p++) {
+        const size_t *h = hist + p * d->buckets;
+        int dedup = unique && p == d->passes - 1;
+        size_t sum = 0;
+        uint32_t *t;
+
+        if (!dedup && is_trivial(h, d->buckets, n))
+            continue;
+        for (b=0; b<d->buckets; b++) {
+            start[b] = pos[b] = sum;
+            sum += h[b];
+        }
+        if (dedup)
+            init_last(last, d);
+        scatter(src, n, dst, pos, d->shift[p], d->mask[p], dedup ? last : NULL);
+        t = src; src = dst; dst = t;
+    }
+
+    if (unique) {
+        /* Close up the gaps the duplicates left at the end of each bucket */
+        count = 0;
+        for (b=0; b<d->buckets; b++) {
+            size_t length = pos[b] - start[b];
+            if (src + start[b] != a + count)
+                memmove(a + count, src + start[b], length * sizeof(*a));
+            count += length;
+        }
+    } else if (src != a)
+        memcpy(a, src, n * sizeof(*a));
+
+    free(last);
+    free(start);
+    free(pos);
+    free(hist);
+    return count;
+}
+
+#if HAVE_PTHREADS
+struct sort_job {
+    const struct digits *d;
+    unsigned threads;
+    size_t n;
+    const uint32_t *src;
+    uint32_t *dst;
+    unsigned pass;
+    int dedup;
+    size_t *hist;               /* [thread][bucket] */
+    size_t *pos;                /* [thread][bucket] */
+};
+
+struct sort_arg {
+    struct sort_job *job;
+    unsigned self;
+    int counting;
+};
+
+static void *
+sort_thread(void *arg) {
+    struct sort_arg *t = arg;
+    struct sort_job *job = t->job;
+    const struct digits *d = job->d;
+    size_t lo = job->n * t->self / job->threads;
+    size_t hi = job->n * (t->self + 1) / job->threads;
+    unsigned shift = d->shift[job->pass];
+    uint32_t mask = d->mask[job->pass];
+
+    if (t->counting) {
+        size_t *h = job->hist + t->self * d->buckets;
+        size_t i;
+
+        memset(h, 0, d->buckets * sizeof(*h));
+        for (i=lo; i<hi; i++)
+            h[(job->src[i] >> shift) & mask]++;
+    } else {
+        uint32_t last[MAX_BUCKETS];
+
+        if (job->dedup)
+            init_last(last, d);
+        scatter(job->src + lo, hi - lo, job->dst, job->pos + t->self * d->buckets,
+                shift, mask, job->dedup ? last : NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Runs one phase of a pass on all the threads, the calling one
+ * included.
+ */
+static void
+run_phase(struct sort_job *job, int counting) {
+    struct sort_arg args[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    unsigned i;
+
+    for (i=0; i<job->threads; i++) {
+        args[i].job = job;
+        args[i].self = i;
+        args[i].counting = counting;
+    }
+    for (i=1; i<job->threads; i++)
+        pthread_create(&tids[i], NULL, sort_thread, &args[i]);
+    sort_thread(&args[0]);
+    for (i=1; i<job->threads; i++)
+        pthread_join(tids[i], NULL);
+}
+
+static size_t
+sort_threaded(uint32_t *a, size_t n, uint32_t *tmp, const struct digits *d, unsigned threads, int unique) {
+    struct sort_job job;
+    size_t *start = malloc(threads * d->buckets * sizeof(*start));
+    uint32_t *src = a;
+    uint32_t *dst = tmp;
+    size_t count = n;
+    unsigned p, t;
+    size_t b;
+
+    job.d = d;
+    job.threads = threads;
+    job.n = n;
+    job.hist = malloc(threads * d->buckets * sizeof(*job.hist));
+    job.pos = malloc(threads * d->buckets * sizeof(*job.pos));
+
+    for (p=0; p<d->passes; p++) {
+        size_t sum = 0;
+        int trivial = 1;
+        uint32_t *tp;
+
+        job.src = src;
+        job.dst = dst;
+        job.pass = p;
+        job.dedup = unique && p == d->passes - 1;
+        run_phase(&job, 1);
+
+        /* Bucket by bucket, and within that, thread by thread */
+        for (b=0; b<d->buckets; b++) {
+            size_t total = 0;
+            for (t=0; t<threads; t++) {
+                size_t i = t * d->buckets + b;
+                start[i] = job.pos[i] = sum;
+                sum += job.hist[i];
+                total += job.hist[i];
+            }
+            if (total != 0 && total != n)
+                trivial = 0;
+        }
+        if (trivial && !job.dedup)
+            continue;
+
+        run_phase(&job, 0);
+        tp = src; src = dst; dst = tp;
+    }
+
+    if (unique) {
+        /* Each thread's part of a bucket is free of duplicates, but its
+         * first address may be the same as the last of the part before */
+        uint32_t prev = 0;
+        int have_prev = 0;
+
+        count = 0;
+        for (b=0; b<d->buckets; b++) {
+            for (t=0; t<threads; t++) {
+                size_t i = t * d->buckets + b;
+                size_t from = start[i];
+                size_t length = job.pos[i] - from;
+
+                if (length && have_prev && src[from] == prev) {
+                    from++;
+                    length--;
+                }
+                if (length == 0)
+                    continue;
+                if (src + from != a + count)
+                    memmove(a + count, src + from, length * sizeof(*a));
+                count += length;
+                prev = a[count - 1];
+                have_prev = 1;
+            }
+        }
+    } else if (src != a)
+        memcpy(a, src, n * sizeof(*a));
+
+    free(job.pos);
+    free(job.hist);
+    free(start);
+    return count;
+}
+#endif
+
+/**
+ * Sorts `a[]` with an LSD radix sort, with `tmp[]`, the same size, as
+ * scratch space. `digit_bits` is 8 or 11. With `threads` above 1, each
+ * pass is split over that many threads. If `unique` is set, duplicates
+ * are removed.
+ * @returns the number of addresses left at the start of `a[]`
+ */
+size_t
+ip_radix_sort(uint32_t *a, size_t n, uint32_t *tmp, unsigned digit_bits, unsigned threads, int unique) {
+    struct digits d = make_digits(digit_bits);
+
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    if (threads > n / 65536)
+        threads = (unsigned)(n / 65536);
+#if HAVE_PTHREADS
+    if (threads > 1)
+        return sort_threaded(a, n, tmp, &d, threads, unique);
+#endif
+    return sort_single(a, n, tmp, &d, unique);
+}
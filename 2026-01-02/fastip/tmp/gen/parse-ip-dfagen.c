@@ -0,0 +1,206 @@
+/*
+    Generated by `dfagen` from the `dfa` tables. Do not edit.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+size_t parse_ip_dfagen(const char *buf, size_t length, uint32_t *out);
+
+size_t parse_ip_dfagen(const char *buf, size_t length, uint32_t *out) {
+    size_t offset = 0;
+    unsigned c;
+    unsigned n1 = 0;
+    unsigned n2 = 0;
+    unsigned n3 = 0;
+    unsigned n4 = 0;
+
+    goto s0;
+
+s0:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n1 = n1 * 10 + (c - '0');
+        goto s1;
+    }
+    return 0;
+
+s1:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n1 = n1 * 10 + (c - '0');
+        goto s2;
+    }
+    if (c == '.') {
+        goto s4;
+    }
+    return 0;
+
+s2:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n1 = n1 * 10 + (c - '0');
+        goto s3;
+    }
+    if (c == '.') {
+        goto s4;
+    }
+    return 0;
+
+s3:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c == '.') {
+        goto s4;
+    }
+    return 0;
+
+s4:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n2 = n2 * 10 + (c - '0');
+        goto s5;
+    }
+    return 0;
+
+s5:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n2 = n2 * 10 + (c - '0');
+        goto s6;
+    }
+    if (c == '.') {
+        goto s8;
+    }
+    return 0;
+
+s6:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n2 = n2 * 10 + (c - '0');
+        goto s7;
+    }
+    if (c == '.') {
+        goto s8;
+    }
+    return 0;
+
+s7:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c == '.') {
+        goto s8;
+    }
+    return 0;
+
+s8:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n3 = n3 * 10 + (c - '0');
+        goto s9;
+    }
+    return 0;
+
+s9:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n3 = n3 * 10 + (c - '0');
+        goto s10;
+    }
+    if (c == '.') {
+        goto s12;
+    }
+    return 0;
+
+s10:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n3 = n3 * 10 + (c - '0');
+        goto s11;
+    }
+    if (c == '.') {
+        goto s12;
+    }
+    return 0;
+
+s11:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c == '.') {
+        goto s12;
+    }
+    return 0;
+
+s12:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n4 = n4 * 10 + (c - '0');
+        goto s13;
+    }
+    return 0;
+
+s13:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n4 = n4 * 10 + (c - '0');
+        goto s14;
+    }
+    if (c == 0 || (c >= 9 && c <= 10) || c == 13 || c == ' ') {
+        goto done;
+    }
+    return 0;
+
+s14:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c >= '0' && c <= '9') {
+        n4 = n4 * 10 + (c - '0');
+        goto s15;
+    }
+    if (c == 0 || (c >= 9 && c <= 10) || c == 13 || c == ' ') {
+        goto done;
+    }
+    return 0;
+
+s15:
+    if (offset == length)
+        goto end;
+    c = (unsigned char)buf[offset++];
+    if (c == 0 || (c >= 9 && c <= 10) || c == 13 || c == ' ') {
+        goto done;
+    }
+    return 0;
+
+done:
+    offset--;  /* not counting the terminator */
+end:
+    if ((n1 > 255) | (n2 > 255) | (n3 > 255) | (n4 > 255))
+        return 0;
+    *out = n1 << 24 | n2 << 16 | n3 << 8 | n4 << 0;
+    return offset;
+}